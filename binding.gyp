@@ -40,6 +40,11 @@
           "<(lldb_lib_dir)/<(lldb_lib)",
         ],
       }],
+      [ "OS == 'linux' or OS == 'freebsd' or OS == 'android'", {
+        # Heap scans run on worker threads.
+        "cflags": [ "-pthread" ],
+        "ldflags": [ "-pthread" ],
+      }],
       [ "coverage == 'true'", {
         "cflags": [ "--coverage" ],
         "ldflags" : [ "--coverage" ],
@@ -52,15 +57,19 @@
     "type": "shared_library",
     "sources": [
       "src/constants.cc",
+      "src/core-file.cc",
       "src/error.cc",
+      "src/heap-index.cc",
       "src/llnode.cc",
       "src/llv8.cc",
       "src/llv8-constants.cc",
+      "src/llv8-layouts.cc",
       "src/llscan.cc",
       "src/printer.cc",
       "src/node.cc",
       "src/node-constants.cc",
       "src/settings.cc",
+      "src/utf16.cc",
     ],
     "conditions": [
       [ "OS == 'win'", {
@@ -85,13 +94,17 @@
           "src/llnode_module.cc",
           "src/llnode_api.cc",
           "src/constants.cc",
+          "src/core-file.cc",
           "src/error.cc",
+          "src/heap-index.cc",
           "src/llv8.cc",
           "src/llv8-constants.cc",
+          "src/llv8-layouts.cc",
           "src/llscan.cc",
           "src/printer.cc",
           "src/node-constants.cc",
           "src/settings.cc",
+          "src/utf16.cc",
         ],
         "cflags!": [ "-fno-exceptions" ],
         "cflags_cc!": [ "-fno-exceptions" ],
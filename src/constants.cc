@@ -1,20 +1,319 @@
+#include <string.h>
+
+#include <chrono>
 #include <cinttypes>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <initializer_list>
 #include <iterator>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include <lldb/API/SBExpressionOptions.h>
 
 #include "src/constants.h"
+#include "src/settings.h"
 
 using lldb::SBAddress;
 using lldb::SBError;
+using lldb::SBModule;
 using lldb::SBSymbol;
 using lldb::SBSymbolContext;
 using lldb::SBSymbolContextList;
 
 namespace llnode {
 
+namespace {
+
+// Never destroyed, constants may outlive static destructors.
+struct ConstantNameTable {
+  std::mutex mutex;
+  // A deque doesn't move its elements when growing.
+  std::deque<std::string> names{std::string()};
+  std::unordered_map<std::string, uint32_t> ids{{std::string(), 0}};
+};
+
+ConstantNameTable& GetConstantNameTable() {
+  static ConstantNameTable* table = new ConstantNameTable();
+  return *table;
+}
+
+// Every postmortem metadata symbol of a target, found with one pass over the
+// symbol tables of its modules instead of one FindSymbols() per constant.
+struct PostmortemSymbolTable {
+  std::mutex mutex;
+  SBTarget target;
+  std::unordered_map<std::string, SBSymbol> symbols;
+};
+
+const char* const kPostmortemPrefixes[] = {"v8dbg_", "nodedbg_"};
+
+bool IsPostmortemSymbol(const char* name) {
+  for (const char* prefix : kPostmortemPrefixes) {
+    if (strncmp(name, prefix, strlen(prefix)) == 0) return true;
+  }
+  return false;
+}
+
+void IndexPostmortemSymbols(PostmortemSymbolTable& table) {
+  auto start = std::chrono::steady_clock::now();
+  size_t scanned = 0;
+
+  table.symbols.clear();
+  for (uint32_t i = 0; i < table.target.GetNumModules(); i++) {
+    SBModule module = table.target.GetModuleAtIndex(i);
+    size_t count = module.GetNumSymbols();
+    scanned += count;
+    for (size_t j = 0; j < count; j++) {
+      SBSymbol symbol = module.GetSymbolAtIndex(j);
+      const char* name = symbol.GetName();
+      if (name == nullptr || !IsPostmortemSymbol(name)) continue;
+
+      // Like FindSymbols(), the first module defining a symbol wins.
+      table.symbols.emplace(name, symbol);
+    }
+  }
+
+  std::chrono::duration<double> time =
+      std::chrono::steady_clock::now() - start;
+  PRINT_DEBUG("Indexed %zu postmortem symbols out of %zu in %.3fs",
+              table.symbols.size(), scanned, time.count());
+}
+
+// Returns the symbol called `name`, or an invalid symbol if there's none.
+SBSymbol FindSymbol(SBTarget target, const char* name) {
+  if (IsPostmortemSymbol(name)) {
+    static PostmortemSymbolTable* table = new PostmortemSymbolTable();
+    std::lock_guard<std::mutex> lock(table->mutex);
+
+    if (table->target != target) {
+      table->target = target;
+      IndexPostmortemSymbols(*table);
+    }
+    // Symbol tables lldb can't enumerate are still searched by name.
+    if (!table->symbols.empty()) {
+      auto it = table->symbols.find(name);
+      return it != table->symbols.end() ? it->second : SBSymbol();
+    }
+  }
+
+  SBSymbolContextList context_list = target.FindSymbols(name);
+  if (!context_list.IsValid() || context_list.GetSize() == 0) {
+    return SBSymbol();
+  }
+  return context_list.GetContextAtIndex(0).GetSymbol();
+}
+
+// Bump whenever the cache file format changes, or when lookups start to
+// resolve differently.
+const int kConstantCacheVersion = 2;
+
+// Symbols defined by every build with V8's or Node.js' postmortem metadata.
+const char* const kConstantCacheAnchors[] = {
+    "v8dbg_SmiTag",
+    "nodedbg_const_Environment__kContextEmbedderDataIndex__int"};
+
+// Build-ids of the modules defining the anchors, joined with '+'. Empty if
+// none of them is found, or if one is in a module without build-id.
+std::string GetConstantsBuildId(SBTarget target) {
+  std::string build_id;
+  for (const char* anchor : kConstantCacheAnchors) {
+    SBSymbolContextList context_list = target.FindSymbols(anchor);
+    if (!context_list.IsValid() || context_list.GetSize() == 0) continue;
+
+    SBModule module = context_list.GetContextAtIndex(0).GetModule();
+    if (!module.IsValid() || module.GetUUIDString() == nullptr) return "";
+    std::string uuid = module.GetUUIDString();
+    if (build_id.find(uuid) != std::string::npos) continue;
+    if (!build_id.empty()) build_id += "+";
+    build_id += uuid;
+  }
+  return build_id;
+}
+
+struct ConstantCacheState {
+  struct Entry {
+    bool found;
+    int64_t value;
+  };
+
+  std::mutex mutex;
+  SBTarget target;
+  std::string build_id;
+  // Empty when lookups on `target` aren't cached.
+  std::string path;
+  std::unordered_map<std::string, Entry> entries;
+  bool dirty = false;
+};
+
+ConstantCacheState& GetConstantCacheState() {
+  static ConstantCacheState* state = new ConstantCacheState();
+  return *state;
+}
+
+// Directory of the cache files, empty if caching is off.
+std::string GetConstantCacheDir() {
+  std::string setting = Settings::GetSettings()->GetConstantsCache();
+  if (setting == "off") return "";
+  if (setting != "auto") return setting;
+
+#ifdef _WIN32
+  return "";
+#else
+  std::string base;
+  const char* xdg_cache = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  if (xdg_cache != nullptr && *xdg_cache != '\0') {
+    base = xdg_cache;
+  } else if (home != nullptr && *home != '\0') {
+    base = std::string(home) + "/.cache";
+  } else {
+    return "";
+  }
+  mkdir(base.c_str(), 0755);
+  std::string dir = base + "/llnode";
+  mkdir(dir.c_str(), 0755);
+  return dir;
+#endif
+}
+
+void LoadConstantCache(ConstantCacheState& state) {
+  std::ifstream file(state.path);
+  if (!file) return;
+
+  std::string magic, build_id;
+  int version;
+  if (!(file >> magic >> version >> build_id) || magic != "llnode-constants" ||
+      version != kConstantCacheVersion || build_id != state.build_id) {
+    PRINT_DEBUG("Ignoring stale constant cache %s", state.path.c_str());
+    return;
+  }
+
+  std::string name;
+  int found;
+  int64_t value;
+  while (file >> name >> found >> value)
+    state.entries[name] = {found != 0, value};
+  PRINT_DEBUG("Loaded %zu constants from %s", state.entries.size(),
+              state.path.c_str());
+}
+
+}  // namespace
+
+
+void ConstantCache::Open(SBTarget target) {
+  ConstantCacheState& state = GetConstantCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.target == target) return;
+
+  state.target = target;
+  state.build_id.clear();
+  state.path.clear();
+  state.entries.clear();
+  state.dirty = false;
+
+  state.build_id = GetConstantsBuildId(target);
+  if (state.build_id.empty()) return;
+
+  std::string dir = GetConstantCacheDir();
+  if (dir.empty()) return;
+  state.path = dir + "/" + state.build_id + ".constants";
+
+  LoadConstantCache(state);
+}
+
+
+std::string ConstantCache::GetBuildId(SBTarget target) {
+  return GetConstantsBuildId(target);
+}
+
+
+void ConstantCache::Flush() {
+  ConstantCacheState& state = GetConstantCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.dirty || state.path.empty()) return;
+  state.dirty = false;
+
+  // Written under a temporary name, other sessions never see a partial file.
+  // The name is unique to this process so that sessions flushing at the same
+  // time don't write to the same file.
+  std::string tmp_path = state.path + ".tmp";
+#ifndef _WIN32
+  tmp_path += "." + std::to_string(getpid());
+#endif
+  {
+    std::ofstream file(tmp_path);
+    file << "llnode-constants " << kConstantCacheVersion << " "
+         << state.build_id << "\n";
+    for (auto& it : state.entries) {
+      file << it.first << " " << (it.second.found ? 1 : 0) << " "
+           << it.second.value << "\n";
+    }
+    if (!file) {
+      PRINT_DEBUG("Failed to write constant cache %s", tmp_path.c_str());
+      file.close();
+      remove(tmp_path.c_str());
+      return;
+    }
+  }
+  if (rename(tmp_path.c_str(), state.path.c_str()) != 0) {
+    PRINT_DEBUG("Failed to write constant cache %s", state.path.c_str());
+    remove(tmp_path.c_str());
+  }
+}
+
+
+bool ConstantCache::Find(SBTarget target, const char* name, bool* found,
+                         int64_t* value) {
+  ConstantCacheState& state = GetConstantCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.path.empty() || state.target != target) return false;
+
+  auto it = state.entries.find(name);
+  if (it == state.entries.end()) return false;
+  *found = it->second.found;
+  *value = it->second.value;
+  return true;
+}
+
+
+void ConstantCache::Insert(SBTarget target, const char* name, bool found,
+                           int64_t value) {
+  ConstantCacheState& state = GetConstantCacheState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (state.path.empty() || state.target != target) return;
+
+  state.entries[name] = {found, found ? value : -1};
+  state.dirty = true;
+}
+
+
+uint32_t ConstantNames::Intern(const char* name) {
+  ConstantNameTable& table = GetConstantNameTable();
+  std::lock_guard<std::mutex> lock(table.mutex);
+
+  auto it = table.ids.find(name);
+  if (it != table.ids.end()) return it->second;
+
+  uint32_t id = table.names.size();
+  table.names.push_back(name);
+  table.ids.emplace(name, id);
+  return id;
+}
+
+const std::string& ConstantNames::Get(uint32_t id) {
+  ConstantNameTable& table = GetConstantNameTable();
+  std::lock_guard<std::mutex> lock(table.mutex);
+  return table.names[id];
+}
+
 template <typename T>
 T ReadSymbolFromTarget(SBTarget& target, SBAddress& start, const char* name,
                        SBError& sberr) {
@@ -24,17 +323,27 @@ T ReadSymbolFromTarget(SBTarget& target, SBAddress& start, const char* name,
 }
 
 Constant<int64_t> Constants::LookupConstant(SBTarget target, const char* name) {
-  int64_t res;
+  bool found;
+  int64_t value;
+  if (ConstantCache::Find(target, name, &found, &value))
+    return found ? Constant<int64_t>(value, name) : Constant<int64_t>();
 
-  SBSymbolContextList context_list = target.FindSymbols(name);
+  bool absent = false;
+  Constant<int64_t> constant = ReadConstant(target, name, &absent);
+  // A read may fail on a core which is missing some pages, the next session
+  // could be luckier.
+  if (constant.Check() || absent)
+    ConstantCache::Insert(target, name, constant.Check(), *constant);
+  return constant;
+}
 
-  if (!context_list.IsValid() || context_list.GetSize() == 0) {
-    return Constant<int64_t>();
-  }
+Constant<int64_t> Constants::ReadConstant(SBTarget target, const char* name,
+                                          bool* absent) {
+  int64_t res;
 
-  SBSymbolContext context = context_list.GetContextAtIndex(0);
-  SBSymbol symbol = context.GetSymbol();
+  SBSymbol symbol = FindSymbol(target, name);
   if (!symbol.IsValid()) {
+    *absent = true;
     return Constant<int64_t>();
   }
 
@@ -56,6 +365,7 @@ Constant<int64_t> Constants::LookupConstant(SBTarget target, const char* name) {
     int8_t tmp = ReadSymbolFromTarget<int8_t>(target, start, name, sberr);
     res = static_cast<int64_t>(tmp);
   } else {
+    *absent = true;
     return Constant<int64_t>();
   }
 
@@ -2,7 +2,9 @@
 #define SRC_CONSTANTS_H_
 
 #include <lldb/API/LLDB.h>
+#include <stdint.h>
 #include <string>
+#include <type_traits>
 
 #include "src/error.h"
 
@@ -12,6 +14,18 @@ namespace llnode {
 
 enum ConstantStatus { kInvalid, kValid, kLoaded };
 
+// Side table with the symbol names constants were loaded from. Constants only
+// keep an id into it, so that they stay trivially copyable and passing one to
+// a field accessor never touches the heap. Names are only needed to tell
+// apart which of several candidate symbols was found, and for debug output.
+class ConstantNames {
+ public:
+  // Id 0 is the empty name, used by constants which weren't loaded.
+  static uint32_t Intern(const char* name);
+  // The returned reference stays valid forever.
+  static const std::string& Get(uint32_t id);
+};
+
 // Class representing a constant which is used to interpret memory data. Most
 // constants represent offset of fields on an object, bit-masks or "tags" which
 // are used to identify types, but there are some constants with different
@@ -30,32 +44,65 @@ enum ConstantStatus { kInvalid, kValid, kLoaded };
 // not safe to use.
 //
 // Use the dereference operator (*constant) to access a constant value.
+//
+// The name of the symbol a constant was loaded from is available through
+// name(), which is meant for debug and error paths only.
 template <typename T>
 class Constant {
  public:
-  Constant() : value_(-1), status_(kInvalid) {}
-  inline bool Check() {
+  Constant() : value_(-1), status_(kInvalid), name_id_(0) {}
+  inline bool Check() const {
     return (status_ == ConstantStatus::kValid ||
             status_ == ConstantStatus::kLoaded);
   }
 
-  inline bool Loaded() { return status_ == kLoaded; }
+  inline bool Loaded() const { return status_ == kLoaded; }
 
-  T operator*() {
+  T operator*() const {
     // TODO(mmarchini): Check()
     return value_;
   }
 
-  inline std::string name() { return name_; }
+  inline const std::string& name() const {
+    return ConstantNames::Get(name_id_);
+  }
 
-  explicit Constant(T value) : value_(value), status_(kValid), name_("") {}
-  Constant(T value, std::string name)
-      : value_(value), status_(kLoaded), name_(name) {}
+  explicit Constant(T value) : value_(value), status_(kValid), name_id_(0) {}
+  Constant(T value, const char* name)
+      : value_(value),
+        status_(kLoaded),
+        name_id_(ConstantNames::Intern(name)) {}
 
  private:
   T value_;
   ConstantStatus status_;
-  std::string name_;
+  uint32_t name_id_;
+};
+
+static_assert(std::is_trivially_copyable<Constant<int64_t>>::value,
+              "Constant must stay cheap to pass by value");
+
+// Results of constant lookups for a build, kept on disk under the build-ids
+// of the modules defining V8's and Node.js' postmortem metadata (the
+// executable, or libnode for shared builds) so that later sessions debugging
+// the same build don't search the symbol tables again. Lookups of symbols
+// which don't exist are kept as well, so that fallback names resolve without
+// lldb too, but not reads which failed.
+class ConstantCache {
+ public:
+  // Switches to the cache of `target`'s build and loads it from disk.
+  static void Open(lldb::SBTarget target);
+  // Writes the cache if lookups were added since it was loaded.
+  static void Flush();
+  // Build-ids the cache of `target` is kept under, joined with '+'. Empty if
+  // they aren't known.
+  static std::string GetBuildId(lldb::SBTarget target);
+
+  // Returns false if `name` wasn't looked up on `target` before.
+  static bool Find(lldb::SBTarget target, const char* name, bool* found,
+                   int64_t* value);
+  static void Insert(lldb::SBTarget target, const char* name, bool found,
+                     int64_t value);
 };
 
 #define CONSTANTS_DEFAULT_METHODS(NAME) \
@@ -63,6 +110,7 @@ class Constant {
     if (loaded_) return this;           \
     loaded_ = true;                     \
     Load();                             \
+    ConstantCache::Flush();             \
     return this;                        \
   }
 
@@ -89,6 +137,13 @@ class Constants {
 
   lldb::SBTarget target_;
   bool loaded_;
+
+ private:
+  // Looks `name` up in the target, bypassing the ConstantCache. `absent` is
+  // set when the target has no usable `name` symbol, as opposed to failing
+  // to read it.
+  static Constant<int64_t> ReadConstant(SBTarget target, const char* name,
+                                        bool* absent);
 };
 
 }  // namespace llnode
@@ -0,0 +1,205 @@
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "src/core-file.h"
+
+namespace llnode {
+
+namespace {
+
+// Just the parts of <elf.h> we need, it isn't available everywhere.
+const uint8_t kElfMagic[4] = {0x7f, 'E', 'L', 'F'};
+const int kElfClassIndex = 4;
+const int kElfDataIndex = 5;
+const uint8_t kElfClass32 = 1;
+const uint8_t kElfClass64 = 2;
+const uint8_t kElfDataLsb = 1;
+const uint8_t kElfDataMsb = 2;
+const uint16_t kElfTypeCore = 4;
+const uint32_t kProgramLoad = 1;
+const uint32_t kProgramWrite = 2;
+
+struct Elf32Ehdr {
+  uint8_t e_ident[16];
+  uint16_t e_type;
+  uint16_t e_machine;
+  uint32_t e_version;
+  uint32_t e_entry;
+  uint32_t e_phoff;
+  uint32_t e_shoff;
+  uint32_t e_flags;
+  uint16_t e_ehsize;
+  uint16_t e_phentsize;
+  uint16_t e_phnum;
+  uint16_t e_shentsize;
+  uint16_t e_shnum;
+  uint16_t e_shstrndx;
+};
+
+struct Elf32Phdr {
+  uint32_t p_type;
+  uint32_t p_offset;
+  uint32_t p_vaddr;
+  uint32_t p_paddr;
+  uint32_t p_filesz;
+  uint32_t p_memsz;
+  uint32_t p_flags;
+  uint32_t p_align;
+};
+
+struct Elf64Ehdr {
+  uint8_t e_ident[16];
+  uint16_t e_type;
+  uint16_t e_machine;
+  uint32_t e_version;
+  uint64_t e_entry;
+  uint64_t e_phoff;
+  uint64_t e_shoff;
+  uint32_t e_flags;
+  uint16_t e_ehsize;
+  uint16_t e_phentsize;
+  uint16_t e_phnum;
+  uint16_t e_shentsize;
+  uint16_t e_shnum;
+  uint16_t e_shstrndx;
+};
+
+struct Elf64Phdr {
+  uint32_t p_type;
+  uint32_t p_flags;
+  uint64_t p_offset;
+  uint64_t p_vaddr;
+  uint64_t p_paddr;
+  uint64_t p_filesz;
+  uint64_t p_memsz;
+  uint64_t p_align;
+};
+
+inline bool IsHostLittleEndian() {
+  const uint16_t word = 1;
+  uint8_t byte;
+  memcpy(&byte, &word, 1);
+  return byte == 1;
+}
+
+}  // namespace
+
+
+void CoreFile::Open(const std::string& path, Error& err) {
+#ifdef _WIN32
+  err = Error::Failure("Mapping core files is not supported on Windows");
+#else
+  Close();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    err = Error::Failure("Failed to open core file '%s'", path.c_str());
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(Elf64Ehdr))) {
+    close(fd);
+    err = Error::Failure("'%s' is not an ELF core file", path.c_str());
+    return;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    err = Error::Failure("Failed to map core file '%s'", path.c_str());
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = st.st_size;
+  path_ = path;
+
+  const uint8_t* ident = data_;
+  uint8_t host_data = IsHostLittleEndian() ? kElfDataLsb : kElfDataMsb;
+  if (memcmp(ident, kElfMagic, sizeof(kElfMagic)) != 0 ||
+      ident[kElfDataIndex] != host_data) {
+    Close();
+    err = Error::Failure("'%s' is not an ELF core file", path.c_str());
+    return;
+  }
+
+  if (ident[kElfClassIndex] == kElfClass64) {
+    LoadSegments<Elf64Ehdr, Elf64Phdr>(err);
+  } else if (ident[kElfClassIndex] == kElfClass32) {
+    LoadSegments<Elf32Ehdr, Elf32Phdr>(err);
+  } else {
+    err = Error::Failure("'%s' is not an ELF core file", path.c_str());
+  }
+  if (err.Fail()) Close();
+#endif
+}
+
+
+template <class Ehdr, class Phdr>
+void CoreFile::LoadSegments(Error& err) {
+  Ehdr header;
+  memcpy(&header, data_, sizeof(header));
+  if (header.e_type != kElfTypeCore || header.e_phentsize != sizeof(Phdr) ||
+      header.e_phoff > size_ ||
+      header.e_phnum > (size_ - header.e_phoff) / sizeof(Phdr)) {
+    err = Error::Failure("'%s' is not an ELF core file", path_.c_str());
+    return;
+  }
+
+  for (uint16_t i = 0; i < header.e_phnum; i++) {
+    Phdr phdr;
+    memcpy(&phdr, data_ + header.e_phoff + i * sizeof(Phdr), sizeof(phdr));
+    if (phdr.p_type != kProgramLoad) continue;
+    if (phdr.p_memsz > 0)
+      ranges_.push_back({phdr.p_vaddr, phdr.p_vaddr + phdr.p_memsz});
+    if (phdr.p_filesz == 0) continue;
+
+    // Truncated cores are common, serve whatever made it into the file.
+    if (phdr.p_offset >= size_) continue;
+    uint64_t filesz = std::min<uint64_t>(
+        std::min<uint64_t>(phdr.p_filesz, phdr.p_memsz),
+        size_ - phdr.p_offset);
+    segments_.push_back({phdr.p_vaddr, phdr.p_vaddr + filesz, phdr.p_offset,
+                         (phdr.p_flags & kProgramWrite) != 0});
+  }
+
+  std::sort(segments_.begin(), segments_.end(),
+            [](const Segment& a, const Segment& b) { return a.start < b.start; });
+  std::sort(ranges_.begin(), ranges_.end());
+  err = Error::Ok();
+}
+
+
+std::vector<std::pair<uint64_t, uint64_t>> CoreFile::Coalesce(
+    const std::vector<std::pair<uint64_t, uint64_t>>& ranges) {
+  std::vector<std::pair<uint64_t, uint64_t>> result;
+  for (const auto& range : ranges) {
+    if (!result.empty() && result.back().second == range.first)
+      result.back().second = range.second;
+    else
+      result.push_back(range);
+  }
+  return result;
+}
+
+
+void CoreFile::Close() {
+#ifndef _WIN32
+  if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+  segments_.clear();
+  ranges_.clear();
+  path_.clear();
+}
+
+}  // namespace llnode
@@ -0,0 +1,127 @@
+#ifndef SRC_CORE_FILE_H_
+#define SRC_CORE_FILE_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/error.h"
+
+namespace llnode {
+
+// Memory of an ELF core file, served straight from a mapping of the file
+// instead of going through lldb. Only the parts of PT_LOAD segments which are
+// present in the file are served, anything else is left to lldb.
+class CoreFile {
+ public:
+  CoreFile() : data_(nullptr), size_(0) {}
+  ~CoreFile() { Close(); }
+  CoreFile(const CoreFile&) = delete;
+  CoreFile& operator=(const CoreFile&) = delete;
+
+  // Maps `path` and reads its segment table. Fails for anything but an ELF
+  // core in the host byte order.
+  void Open(const std::string& path, Error& err);
+  void Close();
+
+  inline bool IsLoaded() const { return data_ != nullptr; }
+  inline const std::string& GetPath() const { return path_; }
+
+  // Returns a pointer to the `size` bytes of memory at `address`, or nullptr
+  // if they are not all in the same segment.
+  inline const uint8_t* GetPointer(uint64_t address, uint64_t size) const;
+
+  // Checks the core is the one described by `regions`, the [start, end)
+  // ranges of the memory regions of the process sorted by address: both must
+  // cover the same addresses. Then calls `callback(address, size)` for a few
+  // bytes of writable segments spread across the core, so that the caller can
+  // check them against another source of memory.
+  template <class Callback>
+  bool VerifySegments(const std::vector<std::pair<uint64_t, uint64_t>>& regions,
+                      Callback callback) const;
+
+ private:
+  struct Segment {
+    uint64_t start;
+    // Only counts the bytes stored in the file.
+    uint64_t end;
+    uint64_t offset;
+    bool writable;
+  };
+
+  // Merges ranges which are next to each other, `ranges` must be sorted.
+  static std::vector<std::pair<uint64_t, uint64_t>> Coalesce(
+      const std::vector<std::pair<uint64_t, uint64_t>>& ranges);
+
+  template <class Ehdr, class Phdr>
+  void LoadSegments(Error& err);
+
+  // Sorted by start address.
+  std::vector<Segment> segments_;
+  // Addresses covered by every PT_LOAD segment, including the parts missing
+  // from the file. Sorted by start address.
+  std::vector<std::pair<uint64_t, uint64_t>> ranges_;
+  std::string path_;
+  const uint8_t* data_;
+  size_t size_;
+};
+
+
+const uint8_t* CoreFile::GetPointer(uint64_t address, uint64_t size) const {
+  if (segments_.empty()) return nullptr;
+
+  // Find the last segment starting at or before `address`.
+  size_t low = 0;
+  size_t high = segments_.size();
+  while (high - low > 1) {
+    size_t mid = low + (high - low) / 2;
+    if (segments_[mid].start <= address)
+      low = mid;
+    else
+      high = mid;
+  }
+
+  const Segment& segment = segments_[low];
+  if (address < segment.start || address > segment.end ||
+      size > segment.end - address) {
+    return nullptr;
+  }
+  return data_ + segment.offset + (address - segment.start);
+}
+
+
+template <class Callback>
+bool CoreFile::VerifySegments(
+    const std::vector<std::pair<uint64_t, uint64_t>>& regions,
+    Callback callback) const {
+  static const size_t kMaxSamples = 8;
+  static const uint64_t kSampleSize = 64;
+
+  // Another core of the same executable has a different memory layout.
+  if (Coalesce(regions) != Coalesce(ranges_)) return false;
+
+  // The first segments are the executable's own, which are the same in every
+  // core of it. Sample writable ones instead, heap and stacks among them.
+  std::vector<const Segment*> writable;
+  for (const Segment& segment : segments_) {
+    if (segment.writable && segment.end > segment.start)
+      writable.push_back(&segment);
+  }
+
+  size_t samples = std::min(writable.size(), kMaxSamples);
+  for (size_t i = 0; i < samples; i++) {
+    const Segment& segment = *writable[i * writable.size() / samples];
+    uint64_t size = std::min(segment.end - segment.start, kSampleSize);
+    // The middle of a segment is less likely to be the same in every core
+    // than its start.
+    uint64_t address = segment.start + (segment.end - segment.start - size) / 2;
+    if (!callback(address, size)) return false;
+  }
+  return true;
+}
+
+}  // namespace llnode
+
+#endif  // SRC_CORE_FILE_H_
@@ -5,8 +5,8 @@
 namespace llnode {
 bool Error::is_debug_mode = false;
 
-Error::Error(bool failed, const char* format, ...) {
-  failed_ = failed;
+Error::Error(bool failed, const char* format, ...)
+    : code_(failed ? kFailure : kOk), static_msg_(nullptr) {
   char tmp[kMaxMessageLength];
   va_list arglist;
   va_start(arglist, format);
@@ -16,6 +16,24 @@ Error::Error(bool failed, const char* format, ...) {
 }
 
 
+const char* Error::GetMessage() const {
+  if (!msg_.empty()) return msg_.c_str();
+  if (static_msg_ != nullptr) return static_msg_;
+
+  switch (code_) {
+    case kOk:
+      return "ok";
+    case kReadFailure:
+      return "Failed to read memory";
+    case kInvalidValue:
+      return "Invalid value";
+    case kFailure:
+      break;
+  }
+  return "Unknown error";
+}
+
+
 void Error::PrintInDebugMode(const char* file, int line, const char* funcname,
                              const char* format, ...) {
   if (!is_debug_mode) {
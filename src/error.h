@@ -9,14 +9,31 @@
 
 namespace llnode {
 
+// Errors are passed around by the hottest paths in llnode (every memory read
+// reports one), so building one doesn't allocate unless it carries a
+// formatted message. Success and failures with a constant message only store
+// a code and a pointer, the text is produced when GetMessage() asks for it.
 class Error {
  public:
-  Error() : failed_(false), msg_("") {}
-  Error(bool failed, std::string msg) : failed_(failed), msg_(msg) {}
+  enum Code {
+    kOk = 0,
+    kFailure,
+    // Memory of the target couldn't be read.
+    kReadFailure,
+    // Memory was read, but doesn't hold what the caller expected.
+    kInvalidValue,
+  };
+
+  Error() : code_(kOk), static_msg_(nullptr) {}
+  // `msg` is neither copied nor formatted, it must be a string literal (or
+  // otherwise outlive the error).
+  Error(Code code, const char* msg) : code_(code), static_msg_(msg) {}
+  Error(bool failed, std::string msg)
+      : code_(failed ? kFailure : kOk), static_msg_(nullptr), msg_(msg) {}
   Error(bool failed, const char* format, ...)
       __attribute__((format(printf, 3, 4)));
 
-  static inline Error Ok() { return Error(false, "ok"); }
+  static inline Error Ok() { return Error(); }
   static Error Failure(std::string msg);
   static Error Failure(const char* format, ...)
       __attribute__((format(printf, 1, 2)));
@@ -25,15 +42,18 @@ class Error {
       __attribute__((format(printf, 4, 5)));
 
   inline bool Success() const { return !Fail(); }
-  inline bool Fail() const { return failed_; }
+  inline bool Fail() const { return code_ != kOk; }
+  inline Code GetCode() const { return code_; }
 
-  inline const char* GetMessage() { return msg_.c_str(); }
+  const char* GetMessage() const;
 
   static void SetDebugMode(bool mode) { is_debug_mode = mode; }
   static bool IsDebugMode() { return is_debug_mode; }
 
  private:
-  bool failed_;
+  Code code_;
+  const char* static_msg_;
+  // Only set for formatted messages.
   std::string msg_;
   static const size_t kMaxMessageLength = 128;
   static bool is_debug_mode;
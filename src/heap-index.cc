@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "src/heap-index.h"
+
+namespace llnode {
+
+namespace {
+
+const char kMagic[8] = {'L', 'L', 'N', 'O', 'D', 'E', 'I', 'X'};
+// Written in native byte order, tells apart files from other architectures.
+const uint32_t kByteOrderMark = 0x01020304;
+
+// All offsets are from the start of the file. Sections are laid out in this
+// order: header, records, strings, instance data and contexts. Instance data
+// and contexts start at 8 byte boundaries.
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t scan_mode;
+  uint64_t core_size;
+  int64_t core_mtime;
+  uint64_t memory_hash;
+  uint32_t core_path_size;
+  uint32_t build_id_size;
+  uint32_t type_count;
+  uint32_t detailed_count;
+  uint64_t context_count;
+  uint64_t records_offset;
+  uint64_t strings_offset;
+  uint64_t strings_size;
+  uint64_t data_offset;
+  uint64_t data_size;
+  uint64_t contexts_offset;
+  uint64_t file_size;
+};
+
+// Describes one TypeRecord or DetailedTypeRecord. String offsets are relative
+// to the strings section and data offsets to the instance data section.
+struct RecordEntry {
+  uint32_t key_offset;
+  uint32_t key_size;
+  uint32_t name_offset;
+  uint32_t name_size;
+  uint64_t instance_count;
+  uint64_t total_instance_size;
+  uint64_t own_descriptors_count;
+  uint64_t indexed_properties_count;
+  uint64_t data_offset;
+  // Number of addresses, or of bytes when compressed.
+  uint64_t data_length;
+  uint32_t compressed;
+  uint32_t detailed;
+};
+
+static_assert(sizeof(Header) == 128, "HeapIndex header must not be padded");
+static_assert(sizeof(RecordEntry) == 72, "HeapIndex record must not be padded");
+
+inline uint64_t AlignTo8(uint64_t offset) { return (offset + 7) & ~7ULL; }
+
+class StringPool {
+ public:
+  uint32_t Add(const std::string& str) {
+    uint32_t offset = data_.size();
+    data_ += str;
+    return offset;
+  }
+
+  const std::string& data() const { return data_; }
+
+ private:
+  std::string data_;
+};
+
+}  // namespace
+
+
+void HeapIndex::Write(const std::string& path, const HeapIndexKey& key,
+                      const TypeRecordMap& types,
+                      const DetailedTypeRecordMap& detailed,
+                      const ContextVector& contexts, Error& err) {
+#ifdef _WIN32
+  err = Error::Failure("Heap indexes are not supported on Windows");
+#else
+  StringPool strings;
+  strings.Add(key.core_path);
+  strings.Add(key.build_id);
+
+  std::vector<RecordEntry> records;
+  std::vector<const InstanceList*> lists;
+  uint64_t data_size = 0;
+  auto add_record = [&](const std::string& table_key, TypeRecord* record,
+                        const DetailedTypeRecord* detailed_record) {
+    const InstanceList& list = record->GetInstances();
+    RecordEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.key_offset = strings.Add(table_key);
+    entry.key_size = table_key.size();
+    entry.name_offset = strings.Add(record->GetTypeName());
+    entry.name_size = record->GetTypeName().size();
+    entry.instance_count = record->GetInstanceCount();
+    entry.total_instance_size = record->GetTotalInstanceSize();
+    if (detailed_record != nullptr) {
+      entry.own_descriptors_count = detailed_record->GetOwnDescriptorsCount();
+      entry.indexed_properties_count =
+          detailed_record->GetIndexedPropertiesCount();
+      entry.detailed = 1;
+    }
+    entry.data_offset = data_size;
+    entry.data_length = list.length_;
+    entry.compressed = list.compressed_;
+    data_size += AlignTo8(list.compressed_ ? list.length_
+                                          : list.length_ * sizeof(uint64_t));
+    records.push_back(entry);
+    lists.push_back(&list);
+  };
+  for (uint32_t id = 0; id < types.size(); id++)
+    add_record(types.GetName(id), types.Get(id), nullptr);
+  for (uint32_t id = 0; id < detailed.size(); id++)
+    add_record(detailed.GetName(id), detailed.Get(id), detailed.Get(id));
+
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrderMark;
+  header.scan_mode = key.scan_mode;
+  header.core_size = key.core_size;
+  header.core_mtime = key.core_mtime;
+  header.memory_hash = key.memory_hash;
+  header.core_path_size = key.core_path.size();
+  header.build_id_size = key.build_id.size();
+  header.type_count = types.size();
+  header.detailed_count = detailed.size();
+  header.context_count = contexts.size();
+  header.records_offset = sizeof(Header);
+  header.strings_offset =
+      header.records_offset + records.size() * sizeof(RecordEntry);
+  header.strings_size = strings.data().size();
+  header.data_offset = AlignTo8(header.strings_offset + header.strings_size);
+  header.data_size = data_size;
+  header.contexts_offset = header.data_offset + data_size;
+  header.file_size =
+      header.contexts_offset + header.context_count * sizeof(uint64_t);
+
+  // Sessions writing the same index at once don't share their temporary file.
+  std::string tmp_path = path + ".tmp." + std::to_string(getpid());
+  std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    err = Error::Failure("Failed to create heap index '%s'", tmp_path.c_str());
+    return;
+  }
+
+  static const char padding[8] = {0};
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()),
+             records.size() * sizeof(RecordEntry));
+  file.write(strings.data().data(), strings.data().size());
+  file.write(padding, header.data_offset - header.strings_offset -
+                          header.strings_size);
+  for (const InstanceList* list : lists) {
+    uint64_t bytes = list->compressed_ ? list->length_
+                                       : list->length_ * sizeof(uint64_t);
+    const char* data =
+        list->compressed_
+            ? reinterpret_cast<const char*>(list->deltas_data_)
+            : reinterpret_cast<const char*>(list->addresses_data_);
+    if (bytes > 0) file.write(data, bytes);
+    file.write(padding, AlignTo8(bytes) - bytes);
+  }
+  for (uint64_t context : contexts)
+    file.write(reinterpret_cast<const char*>(&context), sizeof(context));
+  file.close();
+
+  if (!file) {
+    unlink(tmp_path.c_str());
+    err = Error::Failure("Failed to write heap index '%s'", tmp_path.c_str());
+    return;
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    err = Error::Failure("Failed to rename heap index to '%s'", path.c_str());
+    return;
+  }
+  err = Error::Ok();
+#endif
+}
+
+
+void HeapIndex::Load(const std::string& path, const HeapIndexKey& key,
+                     TypeRecordMap& types, DetailedTypeRecordMap& detailed,
+                     ContextVector& contexts, Error& err) {
+#ifdef _WIN32
+  err = Error::Failure("Heap indexes are not supported on Windows");
+#else
+  Close();
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    err = Error::Failure("Failed to open heap index '%s'", path.c_str());
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    close(fd);
+    err = Error::Failure("Invalid heap index '%s'", path.c_str());
+    return;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    err = Error::Failure("Failed to map heap index '%s'", path.c_str());
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  size_ = st.st_size;
+
+  if (!Validate(key, err)) {
+    Close();
+    return;
+  }
+
+  const Header* header = reinterpret_cast<const Header*>(data_);
+  const RecordEntry* records =
+      reinterpret_cast<const RecordEntry*>(data_ + header->records_offset);
+  const char* strings =
+      reinterpret_cast<const char*>(data_ + header->strings_offset);
+  const uint8_t* instance_data = data_ + header->data_offset;
+
+  uint64_t record_count = header->type_count + header->detailed_count;
+  for (uint64_t i = 0; i < record_count; i++) {
+    const RecordEntry& entry = records[i];
+    std::string table_key(strings + entry.key_offset, entry.key_size);
+    std::string name(strings + entry.name_offset, entry.name_size);
+
+    TypeRecord* record;
+    if (entry.detailed) {
+      DetailedTypeRecord* detailed_record =
+          new DetailedTypeRecord(name, entry.own_descriptors_count,
+                                 entry.indexed_properties_count);
+      detailed[table_key] = detailed_record;
+      record = detailed_record;
+    } else {
+      record = new TypeRecord(name);
+      types[table_key] = record;
+    }
+
+    record->instance_count_ = entry.instance_count;
+    record->total_instance_size_ = entry.total_instance_size;
+    InstanceList& list = record->instances_;
+    list.compressed_ = entry.compressed != 0;
+    list.length_ = entry.data_length;
+    list.size_ = entry.instance_count;
+    if (list.compressed_) {
+      list.deltas_data_ = instance_data + entry.data_offset;
+    } else {
+      list.addresses_data_ =
+          reinterpret_cast<const uint64_t*>(instance_data + entry.data_offset);
+    }
+  }
+
+  const uint64_t* context_data =
+      reinterpret_cast<const uint64_t*>(data_ + header->contexts_offset);
+  contexts.insert(context_data, context_data + header->context_count);
+  err = Error::Ok();
+#endif
+}
+
+
+// Checks the header against the key and every offset against the file size,
+// so that a truncated or corrupt index can't make us read past the mapping.
+bool HeapIndex::Validate(const HeapIndexKey& key, Error& err) const {
+  const Header* header = reinterpret_cast<const Header*>(data_);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->byte_order != kByteOrderMark || header->version != kVersion) {
+    err = Error::Failure("Heap index has an unsupported format");
+    return false;
+  }
+  if (header->file_size != size_) {
+    err = Error::Failure("Heap index is truncated");
+    return false;
+  }
+
+  uint64_t record_count =
+      static_cast<uint64_t>(header->type_count) + header->detailed_count;
+  if (header->records_offset != sizeof(Header) ||
+      header->strings_offset !=
+          header->records_offset + record_count * sizeof(RecordEntry) ||
+      header->strings_size > size_ ||
+      header->data_offset != AlignTo8(header->strings_offset +
+                                      header->strings_size) ||
+      header->data_size > size_ ||
+      header->contexts_offset != header->data_offset + header->data_size ||
+      header->context_count > size_ ||
+      header->contexts_offset + header->context_count * sizeof(uint64_t) !=
+          size_ ||
+      static_cast<uint64_t>(header->core_path_size) + header->build_id_size >
+          header->strings_size) {
+    err = Error::Failure("Heap index is corrupt");
+    return false;
+  }
+
+  const char* strings =
+      reinterpret_cast<const char*>(data_ + header->strings_offset);
+  if (header->scan_mode != key.scan_mode ||
+      header->core_size != key.core_size ||
+      header->core_mtime != key.core_mtime ||
+      header->memory_hash != key.memory_hash ||
+      std::string(strings, header->core_path_size) != key.core_path ||
+      std::string(strings + header->core_path_size, header->build_id_size) !=
+          key.build_id) {
+    err = Error::Failure("Heap index was built for another core");
+    return false;
+  }
+
+  const RecordEntry* records =
+      reinterpret_cast<const RecordEntry*>(data_ + header->records_offset);
+  for (uint64_t i = 0; i < record_count; i++) {
+    const RecordEntry& entry = records[i];
+    uint64_t bytes = entry.compressed ? entry.data_length
+                                      : entry.data_length * sizeof(uint64_t);
+    if (static_cast<uint64_t>(entry.key_offset) + entry.key_size >
+            header->strings_size ||
+        static_cast<uint64_t>(entry.name_offset) + entry.name_size >
+            header->strings_size ||
+        entry.data_length > header->data_size ||
+        entry.data_offset % 8 != 0 || entry.data_offset > header->data_size ||
+        bytes > header->data_size - entry.data_offset ||
+        (!entry.compressed && entry.data_length != entry.instance_count) ||
+        (entry.detailed != 0) != (i >= header->type_count)) {
+      err = Error::Failure("Heap index is corrupt");
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void HeapIndex::Close() {
+#ifndef _WIN32
+  if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+}  // namespace llnode
@@ -0,0 +1,68 @@
+#ifndef SRC_HEAP_INDEX_H_
+#define SRC_HEAP_INDEX_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "src/error.h"
+#include "src/llscan.h"
+
+namespace llnode {
+
+// Identifies the core and the scan settings a heap index was built from, an
+// index is only used when every field matches.
+struct HeapIndexKey {
+  // Empty when llnode doesn't know which file the core was loaded from.
+  std::string core_path;
+  uint64_t core_size = 0;
+  int64_t core_mtime = 0;
+  // Build-ids of the modules defining V8's and Node.js' metadata, as given by
+  // ConstantCache::GetBuildId().
+  std::string build_id;
+  // Hash of the memory region layout and of a sample of memory contents, it
+  // tells cores apart when their path is unknown.
+  uint64_t memory_hash = 0;
+  uint32_t scan_mode = 0;
+};
+
+// On-disk copy of the result of a heap scan: type records with their
+// instances, and the contexts found. Loading memory-maps the file and points
+// the instance lists straight into it, so the index must stay open for as
+// long as the records it produced are alive.
+class HeapIndex {
+ public:
+  // Bump whenever the file layout changes, files with another version are
+  // ignored.
+  static const uint32_t kVersion = 1;
+
+  HeapIndex() : data_(nullptr), size_(0) {}
+  ~HeapIndex() { Close(); }
+  HeapIndex(const HeapIndex&) = delete;
+  HeapIndex& operator=(const HeapIndex&) = delete;
+
+  // Writes finalized records to `path`. The file is written under a temporary
+  // name and renamed, readers never see a partial index.
+  static void Write(const std::string& path, const HeapIndexKey& key,
+                    const TypeRecordMap& types,
+                    const DetailedTypeRecordMap& detailed,
+                    const ContextVector& contexts, Error& err);
+
+  // Maps `path` and fills the (empty) tables from it. Fails without touching
+  // the tables if the file is missing, corrupt or was built for another key.
+  void Load(const std::string& path, const HeapIndexKey& key,
+            TypeRecordMap& types, DetailedTypeRecordMap& detailed,
+            ContextVector& contexts, Error& err);
+
+  inline bool IsLoaded() const { return data_ != nullptr; }
+  void Close();
+
+ private:
+  bool Validate(const HeapIndexKey& key, Error& err) const;
+
+  const uint8_t* data_;
+  size_t size_;
+};
+
+}  // namespace llnode
+
+#endif  // SRC_HEAP_INDEX_H_
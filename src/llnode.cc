@@ -162,6 +162,164 @@ bool SetTreePaddingCmd::DoExecute(SBDebugger d, char** cmd,
   return true;
 }
 
+bool SetScanThreadsCmd::DoExecute(SBDebugger d, char** cmd,
+                                  SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 settings set scan-threads [0..]");
+    return false;
+  }
+  Settings* settings = Settings::GetSettings();
+  std::stringstream option(cmd[0]);
+  int threads;
+
+  if (!(option >> threads) || threads < 0) {
+    result.SetError("unable to convert provided value.");
+    return false;
+  };
+
+  threads = settings->SetScanThreads(threads);
+  if (threads == 0) {
+    result.Printf("Scan threads set to one per core\n");
+  } else {
+    result.Printf("Scan threads set to %d\n", threads);
+  }
+  return true;
+}
+
+bool SetScanReadAheadCmd::DoExecute(SBDebugger d, char** cmd,
+                                    SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 settings set scan-read-ahead [0..]");
+    return false;
+  }
+  Settings* settings = Settings::GetSettings();
+  std::stringstream option(cmd[0]);
+  int blocks;
+
+  if (!(option >> blocks) || blocks < 0) {
+    result.SetError("unable to convert provided value.");
+    return false;
+  };
+
+  blocks = settings->SetScanReadAhead(blocks);
+  if (blocks == 0) {
+    result.Printf("Scan read-ahead disabled\n");
+  } else {
+    result.Printf("Scan read-ahead set to %d blocks\n", blocks);
+  }
+  return true;
+}
+
+bool SetScanModeCmd::DoExecute(SBDebugger d, char** cmd,
+                               SBCommandReturnObject& result) {
+  if (cmd != nullptr && *cmd != nullptr) {
+    Settings* settings = Settings::GetSettings();
+    std::string mode = cmd[0];
+    if (settings->SetScanMode(mode) == mode) {
+      result.Printf("Scan mode set to '%s'\n", mode.c_str());
+      return true;
+    }
+  }
+  result.Printf(
+      "Error: Available options are (pointers | objects | two-pass)\n");
+  return false;
+}
+
+bool SetScanLayoutCmd::DoExecute(SBDebugger d, char** cmd,
+                                 SBCommandReturnObject& result) {
+  if (cmd != nullptr && *cmd != nullptr) {
+    Settings* settings = Settings::GetSettings();
+    std::string layout = cmd[0];
+    if (settings->SetScanLayout(layout) == layout) {
+      result.Printf("Scan layout set to '%s'\n", layout.c_str());
+      return true;
+    }
+  }
+  result.Printf("Error: Available options are (auto | dynamic)\n");
+  return false;
+}
+
+bool SetCompressInstancesCmd::DoExecute(SBDebugger d, char** cmd,
+                                        SBCommandReturnObject& result) {
+  if (cmd != nullptr && *cmd != nullptr) {
+    Settings* settings = Settings::GetSettings();
+    if (strcmp(cmd[0], "on") == 0 || strcmp(cmd[0], "off") == 0) {
+      settings->SetCompressInstances(strcmp(cmd[0], "on") == 0);
+      result.Printf("Instance compression set to '%s'\n", cmd[0]);
+      return true;
+    }
+  }
+  result.Printf("Error: Available options are (on | off)\n");
+  return false;
+}
+
+bool SetHeapIndexCmd::DoExecute(SBDebugger d, char** cmd,
+                                SBCommandReturnObject& result) {
+  if (cmd != nullptr && *cmd != nullptr) {
+    Settings* settings = Settings::GetSettings();
+    std::string heap_index = cmd[0];
+    if (settings->SetHeapIndex(heap_index) == heap_index) {
+      result.Printf("Heap index set to '%s'\n", heap_index.c_str());
+      return true;
+    }
+  }
+  result.Printf("Error: Available options are (auto | off | <path>)\n");
+  return false;
+}
+
+bool SetConstantsCacheCmd::DoExecute(SBDebugger d, char** cmd,
+                                     SBCommandReturnObject& result) {
+  if (cmd != nullptr && *cmd != nullptr) {
+    Settings* settings = Settings::GetSettings();
+    std::string cache = cmd[0];
+    if (settings->SetConstantsCache(cache) == cache) {
+      result.Printf("Constants cache set to '%s'\n", cache.c_str());
+      return true;
+    }
+  }
+  result.Printf("Error: Available options are (auto | off | <directory>)\n");
+  return false;
+}
+
+bool SetMemoryCacheSizeCmd::DoExecute(SBDebugger d, char** cmd,
+                                      SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 settings set memory-cache-size [0..]");
+    return false;
+  }
+  Settings* settings = Settings::GetSettings();
+  std::stringstream option(cmd[0]);
+  int size;
+
+  if (!(option >> size) || size < 0) {
+    result.SetError("unable to convert provided value.");
+    return false;
+  };
+
+  size = settings->SetMemoryCacheSize(size);
+  if (size == 0) {
+    result.Printf("Memory cache disabled\n");
+  } else {
+    result.Printf("Memory cache size set to %d MB\n", size);
+  }
+  return true;
+}
+
+bool SetCoreFileCmd::DoExecute(SBDebugger d, char** cmd,
+                               SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 settings set core-file (<path> | none)");
+    return false;
+  }
+  std::string core_file = Settings::GetSettings()->SetCoreFile(cmd[0]);
+  if (core_file.empty()) {
+    result.Printf("Core file unset\n");
+  } else {
+    result.Printf("Core file set to '%s'\n", core_file.c_str());
+  }
+  return true;
+}
+
 
 bool PrintCmd::DoExecute(SBDebugger d, char** cmd,
                          SBCommandReturnObject& result) {
@@ -212,6 +370,11 @@ bool PrintCmd::DoExecute(SBDebugger d, char** cmd,
 
   result.Printf("%s\n", res.c_str());
   result.SetStatus(eReturnStatusSuccessFinishResult);
+
+  v8::MemoryCache::Stats stats = llv8_->GetMemoryCacheStats();
+  PRINT_DEBUG("Memory cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+              " uncached reads",
+              stats.hits, stats.misses, stats.uncached);
   return true;
 }
 
@@ -414,7 +577,7 @@ bool PluginInitialize(SBDebugger d) {
 
   static llnode::v8::LLV8 llv8;
   static llnode::node::Node node(&llv8);
-  static llnode::LLScan llscan = llnode::LLScan(&llv8);
+  static llnode::LLScan llscan(&llv8);
 
   SBCommandInterpreter interpreter = d.GetCommandInterpreter();
 
@@ -463,7 +626,9 @@ bool PluginInitialize(SBDebugger d) {
                 "List all object types and instance counts grouped by type "
                 "name and sorted by instance count. Use -d or --detailed to "
                 "get an output grouped by type name, properties, and array "
-                "length, as well as more information regarding each type.\n");
+                "length, as well as more information regarding each type. "
+                "Use -j <num> or --jobs <num> to scan the heap with `num` "
+                "threads (0 uses one thread per core).\n");
 
   SBCommand settingsCmd =
       v8.AddMultiwordCommand("settings", "Interpreter settings");
@@ -475,6 +640,49 @@ bool PluginInitialize(SBDebugger d) {
                             "Set color property value");
   setPropertyCmd.AddCommand("tree-padding", new llnode::SetTreePaddingCmd(),
                             "Set tree-padding value");
+  setPropertyCmd.AddCommand("scan-threads", new llnode::SetScanThreadsCmd(),
+                            "Set the number of threads used to scan the heap "
+                            "(0 uses one thread per core)");
+  setPropertyCmd.AddCommand(
+      "scan-read-ahead", new llnode::SetScanReadAheadCmd(),
+      "Set how many blocks of memory a reader thread loads ahead of the heap "
+      "scan workers (0 makes workers load their own blocks)");
+  setPropertyCmd.AddCommand(
+      "scan-mode", new llnode::SetScanModeCmd(),
+      "Set how the heap is scanned: `pointers` treats every word as a "
+      "possible object pointer, `objects` walks objects using their size, "
+      "`two-pass` does the same after collecting every Map in a first pass");
+  setPropertyCmd.AddCommand(
+      "scan-layout", new llnode::SetScanLayoutCmd(),
+      "Set how the heap scan loop decodes objects: with the compile-time "
+      "layout of 64-bit V8 6.x to 9.x without pointer compression when the "
+      "target's debug symbols match it (`auto`), or always from the debug "
+      "symbols (`dynamic`). Other commands always use the debug symbols");
+  setPropertyCmd.AddCommand(
+      "compress-instances", new llnode::SetCompressInstancesCmd(),
+      "Store the addresses found by heap scans as compressed deltas, which "
+      "uses less memory but makes paging through instances slower");
+  setPropertyCmd.AddCommand(
+      "memory-cache-size", new llnode::SetMemoryCacheSizeCmd(),
+      "Set how many MB of process memory are cached between reads (0 "
+      "disables the cache)");
+  setPropertyCmd.AddCommand(
+      "heap-index", new llnode::SetHeapIndexCmd(),
+      "Where heap scan results are saved and reused from across sessions: "
+      "`auto` keeps them next to the `core-file` and does nothing when "
+      "`core-file` isn't set, `off` disables it, anything else is used as the "
+      "index file path");
+  setPropertyCmd.AddCommand(
+      "constants-cache", new llnode::SetConstantsCacheCmd(),
+      "Where constants resolved from debug symbols are cached across "
+      "sessions, one file per build of the modules defining V8's and "
+      "Node.js' metadata: `auto` uses $XDG_CACHE_HOME/llnode "
+      "(~/.cache/llnode), `off` disables it, anything else is used as the "
+      "directory");
+  setPropertyCmd.AddCommand(
+      "core-file", new llnode::SetCoreFileCmd(),
+      "Path of the ELF core being debugged (or `none`). When set, its memory "
+      "is read straight from the file instead of through lldb");
 
   interpreter.AddCommand("findjsobjects", new llnode::FindObjectsCmd(&llscan),
                          "Alias for `v8 findjsobjects`");
@@ -489,6 +697,8 @@ bool PluginInitialize(SBDebugger d) {
                 "entries displayed "
                 "to `num` (use 0 to show all). To get next page repeat command "
                 "or press [ENTER].\n"
+                " * -j <num>  --jobs <num>         - scan the heap with `num` "
+                "threads (0 uses one thread per core).\n"
                 "Accepts the same options as `v8 inspect`");
 
   interpreter.AddCommand("findjsinstances",
@@ -510,6 +720,25 @@ bool PluginInitialize(SBDebugger d) {
       " * -s, --string string  - all properties that refer to the specified "
       "JavaScript string value\n"
       " * -r, --recursive      - walk through references tree recursively\n"
+      " * -b, --breadth-first  - walk through references tree level by level,"
+      " nearest referrers first\n"
+      " * -d, --max-depth num  - stop recursive walks num levels below the "
+      "direct references\n"
+      " * -c, --max-children num - follow at most num referrers of each object "
+      "in recursive walks\n"
+      "\n");
+
+  v8.AddCommand(
+      "findroots", new llnode::FindRootsCmd(&llscan, &node),
+      "Prints the shortest paths of references holding the specified "
+      "JavaScript object from the roots llnode knows about: native contexts, "
+      "global objects and the objects of active handles and requests.\n"
+      "Flags:\n\n"
+      " * -k, --max-paths num  - print at most num paths (default 5)\n"
+      " * -d, --max-depth num  - only look for paths of up to num "
+      "references\n"
+      " * -t, --timeout secs   - stop searching after secs seconds, 0 to "
+      "never stop (default 30)\n"
       "\n");
 
   v8.AddCommand("getactivehandles",
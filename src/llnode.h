@@ -38,6 +38,78 @@ class SetTreePaddingCmd : public CommandBase {
                  lldb::SBCommandReturnObject& result) override;
 };
 
+class SetScanThreadsCmd : public CommandBase {
+ public:
+  ~SetScanThreadsCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetScanReadAheadCmd : public CommandBase {
+ public:
+  ~SetScanReadAheadCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetScanModeCmd : public CommandBase {
+ public:
+  ~SetScanModeCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetScanLayoutCmd : public CommandBase {
+ public:
+  ~SetScanLayoutCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetCompressInstancesCmd : public CommandBase {
+ public:
+  ~SetCompressInstancesCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetHeapIndexCmd : public CommandBase {
+ public:
+  ~SetHeapIndexCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetConstantsCacheCmd : public CommandBase {
+ public:
+  ~SetConstantsCacheCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetMemoryCacheSizeCmd : public CommandBase {
+ public:
+  ~SetMemoryCacheSizeCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
+class SetCoreFileCmd : public CommandBase {
+ public:
+  ~SetCoreFileCmd() override {}
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+};
+
 class PrintCmd : public CommandBase {
  public:
   PrintCmd(v8::LLV8* llv8, bool detailed) : llv8_(llv8), detailed_(detailed) {}
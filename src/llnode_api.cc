@@ -51,6 +51,7 @@ bool LLNodeApi::Init(const char* filename, const char* executable) {
   }
 
   *process = target->LoadCore(filename);
+  llv8->SetCoreFile(filename);
   // Load V8 constants from postmortem data
   llscan->v8()->Load(*target);
   initialized_ = true;
@@ -144,9 +145,8 @@ void LLNodeApi::ScanHeap() {
   object_types.clear();
 
   // Load the object types into a vector
-  for (const auto& kv : llscan->GetMapsToInstances()) {
-    object_types.push_back(kv.second);
-  }
+  object_types.assign(llscan->GetMapsToInstances().begin(),
+                      llscan->GetMapsToInstances().end());
 
   // Sort by instance count
   std::sort(object_types.begin(), object_types.end(),
@@ -176,11 +176,12 @@ uint32_t LLNodeApi::GetTypeTotalSize(size_t type_index) {
   return object_types[type_index]->GetTotalInstanceSize();
 }
 
-std::unordered_set<uint64_t>* LLNodeApi::GetTypeInstances(size_t type_index) {
+std::vector<uint64_t> LLNodeApi::GetTypeInstances(size_t type_index) {
   if (object_types.size() <= type_index) {
-    return nullptr;
+    return std::vector<uint64_t>();
   }
-  return &(object_types[type_index]->GetInstances());
+  const InstanceList& instances = object_types[type_index]->GetInstances();
+  return std::vector<uint64_t>(instances.begin(), instances.end());
 }
 
 std::string LLNodeApi::GetObject(uint64_t address) {
@@ -5,7 +5,6 @@
 
 #include <memory>
 #include <string>
-#include <unordered_set>
 #include <vector>
 
 namespace lldb {
@@ -51,7 +50,7 @@ class LLNodeApi {
   std::string GetTypeName(size_t type_index);
   uint32_t GetTypeInstanceCount(size_t type_index);
   uint32_t GetTypeTotalSize(size_t type_index);
-  std::unordered_set<uint64_t>* GetTypeInstances(size_t type_index);
+  std::vector<uint64_t> GetTypeInstances(size_t type_index);
   // TODO(joyeecheung): templatize all the `Inspect` in llv8.h to
   // return structured data
   std::string GetObject(uint64_t address);
@@ -255,14 +255,10 @@ LLNode* LLNodeHeapType::llnode() {
 }
 
 void LLNodeHeapType::InitInstances() {
-  auto instances_set =
+  this->type_instances_ =
       this->llnode()->api_->GetTypeInstances(this->type_index_);
   this->current_instance_index_ = 0;
 
-  for (const uint64_t& addr : *instances_set) {
-    this->type_instances_.push_back(addr);
-  }
-
   this->type_ins_count_ = this->type_instances_.size();
   this->instances_initialized_ = true;
 }
@@ -2,22 +2,35 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <climits>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include <lldb/API/SBExpressionOptions.h>
 
 #include "deps/rang/include/rang.hpp"
+#include "src/constants.h"
 #include "src/error.h"
+#include "src/heap-index.h"
 #include "src/llscan.h"
 #include "src/llv8-inl.h"
+#include "src/node-inl.h"
 #include "src/settings.h"
 
 namespace llnode {
@@ -34,7 +47,146 @@ using lldb::SBTarget;
 using lldb::SBValue;
 
 
-char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
+InstanceList::iterator::iterator(const InstanceList* list, size_t pos)
+    : list_(list), pos_(pos), next_(pos), value_(0) {
+  if (list_->compressed_) Decode();
+}
+
+
+InstanceList::iterator& InstanceList::iterator::operator++() {
+  pos_ = list_->compressed_ ? next_ : pos_ + 1;
+  if (list_->compressed_) Decode();
+  return *this;
+}
+
+
+// Reads the delta at pos_ and adds it to the current value.
+void InstanceList::iterator::Decode() {
+  const uint8_t* deltas = list_->deltas_data_;
+  if (pos_ >= list_->length_) return;
+
+  uint64_t delta = 0;
+  int shift = 0;
+  for (next_ = pos_; next_ < list_->length_; shift += 7) {
+    uint8_t byte = deltas[next_++];
+    delta |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) break;
+  }
+  value_ += delta;
+}
+
+
+void InstanceList::Assign(std::vector<uint64_t>&& addresses, bool compress) {
+  size_ = addresses.size();
+  compressed_ = compress;
+  deltas_.clear();
+  addresses_.clear();
+
+  if (!compress) {
+    addresses_ = std::move(addresses);
+    addresses_.shrink_to_fit();
+    addresses_data_ = addresses_.data();
+    deltas_data_ = nullptr;
+    length_ = addresses_.size();
+    return;
+  }
+
+  uint64_t previous = 0;
+  for (uint64_t address : addresses) {
+    uint64_t delta = address - previous;
+    previous = address;
+    do {
+      uint8_t byte = delta & 0x7f;
+      delta >>= 7;
+      deltas_.push_back(delta != 0 ? byte | 0x80 : byte);
+    } while (delta != 0);
+  }
+  deltas_.shrink_to_fit();
+  addresses_data_ = nullptr;
+  deltas_data_ = deltas_.data();
+  length_ = deltas_.size();
+}
+
+
+const size_t TypeRecord::kMinCompactSize;
+
+
+void TypeRecord::Merge(TypeRecord* other) {
+  pending_.insert(pending_.end(), other->pending_.begin(),
+                  other->pending_.end());
+  std::vector<uint64_t>().swap(other->pending_);
+  unpacked_.insert(unpacked_.end(), other->unpacked_.begin(),
+                   other->unpacked_.end());
+  std::vector<std::pair<uint64_t, uint64_t>>().swap(other->unpacked_);
+  if (pending_.size() >= compact_at_) Compact();
+}
+
+
+void TypeRecord::Compact() {
+  std::sort(pending_.begin(), pending_.end());
+  pending_.erase(std::unique(pending_.begin(), pending_.end()),
+                 pending_.end());
+  compact_at_ = std::max(kMinCompactSize, pending_.size() * 2);
+}
+
+
+void TypeRecord::Finalize(bool compress) {
+  // Sort by address only, sizes live in the upper bits.
+  std::sort(pending_.begin(), pending_.end(), [](uint64_t a, uint64_t b) {
+    return (a & kAddressMask) < (b & kAddressMask);
+  });
+
+  std::vector<uint64_t> addresses;
+  addresses.reserve(pending_.size());
+  instance_count_ = 0;
+  total_instance_size_ = 0;
+  for (uint64_t entry : pending_) {
+    uint64_t address = entry & kAddressMask;
+    if (!addresses.empty() && addresses.back() == address) continue;
+
+    addresses.push_back(address);
+    instance_count_++;
+    total_instance_size_ += entry >> kSizeShift;
+  }
+  std::vector<uint64_t>().swap(pending_);
+
+  if (!unpacked_.empty()) {
+    std::sort(unpacked_.begin(), unpacked_.end());
+    size_t packed = addresses.size();
+    for (const auto& entry : unpacked_) {
+      if (std::binary_search(addresses.begin(), addresses.begin() + packed,
+                             entry.first) ||
+          (addresses.size() > packed && addresses.back() == entry.first)) {
+        continue;
+      }
+      addresses.push_back(entry.first);
+      instance_count_++;
+      total_instance_size_ += entry.second;
+    }
+    std::inplace_merge(addresses.begin(), addresses.begin() + packed,
+                       addresses.end());
+    std::vector<std::pair<uint64_t, uint64_t>>().swap(unpacked_);
+  }
+  compact_at_ = kMinCompactSize;
+
+  instances_.Assign(std::move(addresses), compress);
+}
+
+
+HeapScanOptions::HeapScanOptions()
+    : jobs(Settings::GetSettings()->GetScanThreads()),
+      mode(kScanPointers),
+      compress_instances(Settings::GetSettings()->GetCompressInstances()),
+      read_ahead(Settings::GetSettings()->GetScanReadAhead()),
+      static_layout(Settings::GetSettings()->GetScanLayout() == "auto") {
+  std::string scan_mode = Settings::GetSettings()->GetScanMode();
+  if (scan_mode == "objects") mode = kScanObjects;
+  if (scan_mode == "two-pass") mode = kScanTwoPass;
+}
+
+
+char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options,
+                           HeapScanOptions* scan_options) {
   static struct option opts[] = {
       {"full-string", no_argument, nullptr, 'F'},
       {"string-length", required_argument, nullptr, 'l'},
@@ -45,6 +197,7 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
       {"verbose", no_argument, nullptr, 'v'},
       {"detailed", no_argument, nullptr, 'd'},
       {"output-limit", required_argument, nullptr, 'n'},
+      {"jobs", required_argument, nullptr, 'j'},
       {nullptr, 0, nullptr, 0}};
 
   int argc = 1;
@@ -62,7 +215,7 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
   optind = 0;
   opterr = 1;
   do {
-    int arg = getopt_long(argc, args, "Fmsdvl:n:", opts, nullptr);
+    int arg = getopt_long(argc, args, "Fmsdvl:n:j:", opts, nullptr);
     if (arg == -1) break;
 
     switch (arg) {
@@ -86,6 +239,14 @@ char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options) {
         int limit = strtol(optarg, nullptr, 10);
         options->output_limit = limit && limit > 0 ? limit : 0;
       } break;
+      case 'j': {
+        if (scan_options == nullptr) break;
+        // 0 means one thread per core, don't let a typo ask for that.
+        char* end;
+        long jobs = strtol(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || jobs < 0) return nullptr;
+        scan_options->jobs = jobs;
+      } break;
       default:
         continue;
     }
@@ -106,14 +267,19 @@ bool FindObjectsCmd::DoExecute(SBDebugger d, char** cmd,
   // Load V8 constants from postmortem data
   llscan_->v8()->Load(target);
 
-  /* Ensure we have a map of objects. */
-  if (!llscan_->ScanHeapForObjects(target, result)) {
+  Printer::PrinterOptions printer_options;
+  HeapScanOptions scan_options;
+  if (ParsePrinterOptions(cmd, &printer_options, &scan_options) == nullptr) {
+    result.SetError("Invalid number of jobs");
     result.SetStatus(eReturnStatusFailed);
     return false;
   }
 
-  Printer::PrinterOptions printer_options;
-  ParsePrinterOptions(cmd, &printer_options);
+  /* Ensure we have a map of objects. */
+  if (!llscan_->ScanHeapForObjects(target, result, scan_options)) {
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
 
   if (printer_options.detailed) {
     DetailedOutput(result);
@@ -130,12 +296,9 @@ void FindObjectsCmd::SimpleOutput(SBCommandReturnObject& result) {
   /* Create a vector to hold the entries sorted by instance count
    * TODO(hhellyer) - Make sort type an option (by count, size or name)
    */
-  std::vector<TypeRecord*> sorted_by_count;
-  TypeRecordMap::iterator end = llscan_->GetMapsToInstances().end();
-  for (TypeRecordMap::iterator it = llscan_->GetMapsToInstances().begin();
-       it != end; ++it) {
-    sorted_by_count.push_back(it->second);
-  }
+  std::vector<TypeRecord*> sorted_by_count(
+      llscan_->GetMapsToInstances().begin(),
+      llscan_->GetMapsToInstances().end());
 
   std::sort(sorted_by_count.begin(), sorted_by_count.end(),
             TypeRecord::CompareInstanceCounts);
@@ -161,10 +324,9 @@ void FindObjectsCmd::SimpleOutput(SBCommandReturnObject& result) {
 
 
 void FindObjectsCmd::DetailedOutput(SBCommandReturnObject& result) {
-  std::vector<DetailedTypeRecord*> sorted_by_count;
-  for (auto kv : llscan_->GetDetailedMapsToInstances()) {
-    sorted_by_count.push_back(kv.second);
-  }
+  std::vector<DetailedTypeRecord*> sorted_by_count(
+      llscan_->GetDetailedMapsToInstances().begin(),
+      llscan_->GetDetailedMapsToInstances().end());
 
   std::sort(sorted_by_count.begin(), sorted_by_count.end(),
             TypeRecord::CompareInstanceCounts);
@@ -209,29 +371,33 @@ bool FindInstancesCmd::DoExecute(SBDebugger d, char** cmd,
   // Load V8 constants from postmortem data
   llscan_->v8()->Load(target);
 
-  /* Ensure we have a map of objects. */
-  if (!llscan_->ScanHeapForObjects(target, result)) {
-    result.SetStatus(eReturnStatusFailed);
-    return false;
-  }
-
   Printer::PrinterOptions printer_options;
+  HeapScanOptions scan_options;
 
   printer_options.detailed = detailed_;
 
   // Use same options as inspect?
-  char** start = ParsePrinterOptions(cmd, &printer_options);
+  char** start = ParsePrinterOptions(cmd, &printer_options, &scan_options);
+  if (start == nullptr) {
+    result.SetError("Invalid number of jobs");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+
+  /* Ensure we have a map of objects. */
+  if (!llscan_->ScanHeapForObjects(target, result, scan_options)) {
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
 
   std::string full_cmd;
   for (; start != nullptr && *start != nullptr; start++) full_cmd += *start;
 
   std::string type_name = full_cmd;
 
-  TypeRecordMap::iterator instance_it =
-      llscan_->GetMapsToInstances().find(type_name);
+  TypeRecord* t = llscan_->GetMapsToInstances().Find(type_name);
 
-  if (instance_it != llscan_->GetMapsToInstances().end()) {
-    TypeRecord* t = instance_it->second;
+  if (t != nullptr) {
 
     // Update pagination options
     if (full_cmd != pagination_.command ||
@@ -314,11 +480,9 @@ bool NodeInfoCmd::DoExecute(SBDebugger d, char** cmd,
 
   std::string process_type_name("process");
 
-  TypeRecordMap::iterator instance_it =
-      llscan_->GetMapsToInstances().find(process_type_name);
+  TypeRecord* t = llscan_->GetMapsToInstances().Find(process_type_name);
 
-  if (instance_it != llscan_->GetMapsToInstances().end()) {
-    TypeRecord* t = instance_it->second;
+  if (t != nullptr) {
     for (auto it : t->GetInstances()) {
       Error err;
 
@@ -487,6 +651,11 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
 
   ScanOptions scan_options;
   char** start = ParseScanOptions(cmd, &scan_options);
+  if (start == nullptr) {
+    result.SetError("Invalid option value");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
 
   if (*start == nullptr) {
     result.SetError("Missing search parameter");
@@ -495,6 +664,7 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
   }
 
   ObjectScanner* scanner;
+  uint64_t value_address = 0;
 
   switch (scan_options.scan_type) {
     case ScanOptions::ScanType::kFieldValue: {
@@ -518,6 +688,7 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
         return false;
       }
       scanner = new ReferenceScanner(llscan_, search_value);
+      value_address = search_value.raw();
       break;
     }
     case ScanOptions::ScanType::kPropertyName: {
@@ -565,26 +736,45 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
   }
 
   if (!scanner->AreReferencesLoaded()) {
-    ScanForReferences(scanner);
+    scanner->LoadReferences(this);
   }
 
   // If we're using recursive findrefs, we have to make sure the
-  // RecursiveScanner is initialized as well.
-  if (scan_options.recursive_scan) {
-    auto ref_scanner = new ReferenceScanner(llscan_, v8::Value());
-    if (!ref_scanner->AreReferencesLoaded()) {
-      ScanForReferences(ref_scanner);
-    }
+  // reference graph is built as well.
+  if (scan_options.recursive_scan &&
+      !llscan_->GetReferenceGraph().IsLoaded()) {
+    llscan_->BuildReferenceGraph();
   }
 
   // Store already visited references to avoid and infinite recursive loop
   // when `--recursive (-r)` option is set
-  ReferencesVector already_visited_references;
+  AddressSet already_visited_references;
 
   // Get the list of references for the given search value, property or string
   ReferencesVector* references = scanner->GetReferences();
-  PrintReferences(result, references, scanner, &scan_options,
-                  &already_visited_references);
+  if (scan_options.breadth_first) {
+    // Direct references first, then the levels below them.
+    scan_options.recursive_scan = false;
+    PrintReferences(result, references, scanner, &scan_options,
+                    &already_visited_references);
+
+    ReferencesVector roots(*references);
+    if (scan_options.scan_type == ScanOptions::ScanType::kFieldValue) {
+      // Contexts referring to the value are printed apart from the rest.
+      const ReferenceGraph& graph = llscan_->GetReferenceGraph();
+      size_t begin, end;
+      graph.FindEdges(value_address, &begin, &end);
+      for (size_t edge = begin; edge < end; edge++) {
+        if (graph.GetKind(edge) == ReferenceGraph::kContextVariable)
+          roots.push_back(graph.GetSource(edge));
+      }
+    }
+    PrintBreadthFirstReferences(result, &scan_options,
+                                &already_visited_references, roots, 0);
+  } else {
+    PrintReferences(result, references, scanner, &scan_options,
+                    &already_visited_references);
+  }
 
   delete scanner;
 
@@ -593,48 +783,120 @@ bool FindReferencesCmd::DoExecute(SBDebugger d, char** cmd,
 }
 
 
-void FindReferencesCmd::ScanForReferences(ObjectScanner* scanner) {
-  // Walk all the object instances and handle them according to their type.
-  TypeRecordMap mapstoinstances = llscan_->GetMapsToInstances();
-  for (auto const entry : mapstoinstances) {
-    TypeRecord* typerecord = entry.second;
+template <typename Work>
+static void RunScanWorkers(size_t jobs, Work work);
 
-    for (uint64_t addr : typerecord->GetInstances()) {
-      Error err;
-      v8::Value obj_value(llscan_->v8(), addr);
-      v8::HeapObject heap_object(obj_value);
-      int64_t type = heap_object.GetType(err);
-      v8::LLV8* v8 = heap_object.v8();
-
-      // We only need to handle the types that are in
-      // FindJSObjectsVisitor::IsAHistogramType
-      // as those are the only objects that end up in GetMapsToInstances
-      if (v8::JSObject::IsObjectType(v8, type) ||
-          type == v8->types()->kJSArrayType) {
-        // Objects can have elements and arrays can have named properties.
-        // Basically we need to access objects and arrays as both objects and
-        // arrays.
-        v8::JSObject js_obj(heap_object);
-        scanner->ScanRefs(js_obj, err);
-
-      } else if (type < v8->types()->kFirstNonstringType) {
-        v8::String str(heap_object);
-        scanner->ScanRefs(str, err);
-
-      } else if (type == v8->types()->kJSTypedArrayType) {
-        // These should only point to off heap memory,
-        // this case should be a no-op.
-      } else {
-        // result.Printf("Unhandled type: %" PRId64 " for addr %" PRIx64
-        //    "\n", type, addr);
+
+template <class Bucket, class Visit, class Merge>
+void LLScan::VisitInstances(size_t jobs, Visit visit, Merge merge) {
+  static const size_t kBatchSize = 1024;
+
+  // Instance lists can only be walked forward, find where each batch starts.
+  struct Batch {
+    InstanceList::iterator begin;
+    size_t count;
+  };
+  std::vector<Batch> batches;
+  for (TypeRecord* typerecord : mapstoinstances_.SortedByName()) {
+    const InstanceList& instances = typerecord->GetInstances();
+    size_t pos = 0;
+    for (auto it = instances.begin(); it != instances.end(); ++it, ++pos) {
+      if (pos % kBatchSize == 0)
+        batches.push_back({it, std::min(kBatchSize, instances.size() - pos)});
+    }
+  }
+
+  if (jobs == 0) jobs = std::thread::hardware_concurrency();
+  jobs = std::max<size_t>(1, std::min(jobs, batches.size()));
+
+  // V8 constants are loaded lazily on first use, make sure workers won't race
+  // to load them.
+  if (jobs > 1) v8()->LoadAllConstants();
+
+  // Buckets are merged as soon as every batch before them is, so only the
+  // ones finished out of order wait in memory.
+  std::vector<std::unique_ptr<Bucket>> finished(batches.size());
+  size_t next_merge = 0;
+  std::mutex merge_mutex;
+  std::atomic<size_t> next_batch(0);
+  RunScanWorkers(jobs, [&](size_t worker) {
+    for (size_t i = next_batch++; i < batches.size(); i = next_batch++) {
+      std::unique_ptr<Bucket> bucket(new Bucket());
+      InstanceList::iterator it = batches[i].begin;
+      for (size_t n = 0; n < batches[i].count; n++, ++it) visit(*it, *bucket);
+
+      std::lock_guard<std::mutex> lock(merge_mutex);
+      finished[i] = std::move(bucket);
+      for (; next_merge < finished.size() && finished[next_merge];
+           next_merge++) {
+        merge(*finished[next_merge]);
+        finished[next_merge].reset();
       }
     }
+  });
+}
+
+
+void FindReferencesCmd::ScanForReferences(ObjectScanner* scanner) {
+  // Walk all the object instances and handle them according to their type.
+  // Buckets are merged in the order of SortedByName(), so references come
+  // out in the same order regardless of how the work was split.
+  llscan_->VisitInstances<ReferenceBucket>(
+      Settings::GetSettings()->GetScanThreads(),
+      [this, scanner](uint64_t addr, ReferenceBucket& bucket) {
+        Error err;
+        v8::Value obj_value(llscan_->v8(), addr);
+        v8::HeapObject heap_object(obj_value);
+        int64_t type = heap_object.GetType(err);
+        v8::LLV8* v8 = heap_object.v8();
+
+        // We only need to handle the types that are in
+        // FindJSObjectsVisitor::IsAHistogramType
+        // as those are the only objects that end up in GetMapsToInstances
+        if (v8::JSObject::IsObjectType(v8, type) ||
+            type == v8->types()->kJSArrayType) {
+          // Objects can have elements and arrays can have named properties.
+          // Basically we need to access objects and arrays as both objects
+          // and arrays.
+          v8::JSObject js_obj(heap_object);
+          scanner->ScanRefs(js_obj, bucket, err);
+
+        } else if (type < v8->types()->kFirstNonstringType) {
+          v8::String str(heap_object);
+          scanner->ScanRefs(str, bucket, err);
+
+        } else if (type == v8->types()->kJSTypedArrayType) {
+          // These should only point to off heap memory,
+          // this case should be a no-op.
+        }
+      },
+      [scanner](ReferenceBucket& bucket) { scanner->MergeRefs(bucket); });
+}
+
+// Finds where the edges from the source of `edge` end, edges of a source are
+// next to each other.
+static size_t NextSource(const ReferenceGraph& graph, size_t edge, size_t end) {
+  uint64_t source = graph.GetSource(edge);
+  for (edge++; edge < end && graph.GetSource(edge) == source; edge++) {
   }
+  return edge;
 }
 
+
+static size_t CountSources(const ReferenceGraph& graph, size_t begin,
+                           size_t end) {
+  size_t count = 0;
+  for (size_t edge = begin; edge < end; edge = NextSource(graph, edge, end))
+    count++;
+  return count;
+}
+
+
 void FindReferencesCmd::PrintRecursiveReferences(
     lldb::SBCommandReturnObject& result, ScanOptions* options,
-    ReferencesVector* visited_references, uint64_t address, int level) {
+    AddressSet* visited_references, uint64_t address, int level) {
+  if (options->max_depth > 0 && level >= options->max_depth) return;
+
   Settings* settings = Settings::GetSettings();
   unsigned int padding = settings->GetTreePadding();
 
@@ -642,29 +904,91 @@ void FindReferencesCmd::PrintRecursiveReferences(
 
   result.Printf("%s", branch.c_str());
 
-  if (find(visited_references->begin(), visited_references->end(), address) !=
-      visited_references->end()) {
+  if (visited_references->Contains(address)) {
     std::stringstream seen_str;
     seen_str << rang::fg::red << " [seen above]" << rang::fg::reset
              << std::endl;
     result.Printf("%s", seen_str.str().c_str());
-  } else {
-    visited_references->push_back(address);
-    v8::Value value(llscan_->v8(), address);
-    ReferenceScanner scanner_(llscan_, value);
-    ReferencesVector* references_ = scanner_.GetReferences();
-    PrintReferences(result, references_, &scanner_, options, visited_references,
-                    level + 1);
+    return;
+  }
+  visited_references->Insert(address);
+
+  // Walk the graph directly, every source is printed and followed in turn.
+  const ReferenceGraph& graph = llscan_->GetReferenceGraph();
+  size_t begin, end;
+  graph.FindEdges(address, &begin, &end);
+  int children = 0;
+  for (size_t edge = begin; edge < end;) {
+    size_t next = NextSource(graph, edge, end);
+    if (options->max_children > 0 && children == options->max_children) {
+      std::string indent(padding * (level + 1), ' ');
+      result.Printf("%s... %zu more\n", indent.c_str(),
+                    CountSources(graph, edge, end));
+      break;
+    }
+    children++;
+
+    ReferenceScanner::PrintEdges(result, llscan_, graph, address, edge, next,
+                                 "");
+    PrintRecursiveReferences(result, options, visited_references,
+                             graph.GetSource(edge), level + 1);
+    edge = next;
+  }
+}
+
+
+void FindReferencesCmd::PrintBreadthFirstReferences(
+    SBCommandReturnObject& result, ScanOptions* options,
+    AddressSet* visited_references, const ReferencesVector& references,
+    int level) {
+  Settings* settings = Settings::GetSettings();
+  unsigned int padding = settings->GetTreePadding();
+  const ReferenceGraph& graph = llscan_->GetReferenceGraph();
+
+  // Objects whose referrers are still to print, with their level.
+  std::deque<std::pair<uint64_t, int>> pending;
+  for (uint64_t address : references) {
+    if (visited_references->Contains(address)) continue;
+    visited_references->Insert(address);
+    pending.emplace_back(address, level);
+  }
+
+  while (!pending.empty()) {
+    uint64_t address = pending.front().first;
+    int depth = pending.front().second;
+    pending.pop_front();
+    if (options->max_depth > 0 && depth >= options->max_depth) continue;
+
+    std::string indent(padding * (depth + 1), ' ');
+    size_t begin, end;
+    graph.FindEdges(address, &begin, &end);
+    int children = 0;
+    for (size_t edge = begin; edge < end;) {
+      size_t next = NextSource(graph, edge, end);
+      if (options->max_children > 0 && children == options->max_children) {
+        result.Printf("%s... %zu more\n", indent.c_str(),
+                      CountSources(graph, edge, end));
+        break;
+      }
+      children++;
+
+      ReferenceScanner::PrintEdges(result, llscan_, graph, address, edge,
+                                   next, indent);
+      uint64_t source = graph.GetSource(edge);
+      if (!visited_references->Contains(source)) {
+        visited_references->Insert(source);
+        pending.emplace_back(source, depth + 1);
+      }
+      edge = next;
+    }
   }
 }
 
+
 void FindReferencesCmd::PrintReferences(
     SBCommandReturnObject& result, ReferencesVector* references,
     ObjectScanner* scanner, ScanOptions* options,
-    ReferencesVector* already_visited_references, int level) {
-  // Walk all the object instances and handle them according to their type.
-  TypeRecordMap mapstoinstances = llscan_->GetMapsToInstances();
-
+    AddressSet* already_visited_references, int level) {
   for (uint64_t addr : *references) {
     Error err;
     v8::Value obj_value(llscan_->v8(), addr);
@@ -713,11 +1037,28 @@ void FindReferencesCmd::PrintReferences(
 }
 
 
+// Parses the argument of a numeric option, which must be a number between
+// `min` and INT_MAX. Returns false if it isn't one.
+static bool ParseNumericOption(const char* arg, long min, int* value) {
+  char* end;
+  long number = strtol(arg, &end, 10);
+  if (end == arg || *end != '\0' || number < min || number > INT_MAX) {
+    return false;
+  }
+  *value = number;
+  return true;
+}
+
+
 char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
   static struct option opts[] = {{"value", no_argument, nullptr, 'v'},
                                  {"name", no_argument, nullptr, 'n'},
                                  {"string", no_argument, nullptr, 's'},
                                  {"recursive", no_argument, nullptr, 'r'},
+                                 {"breadth-first", no_argument, nullptr, 'b'},
+                                 {"max-depth", required_argument, nullptr, 'd'},
+                                 {"max-children", required_argument, nullptr,
+                                  'c'},
                                  {nullptr, 0, nullptr, 0}};
 
   int argc = 1;
@@ -737,10 +1078,11 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
   optind = 0;
   opterr = 1;
   do {
-    int arg = getopt_long(argc, args, "vnsr", opts, nullptr);
+    int arg = getopt_long(argc, args, "vnsrbd:c:", opts, nullptr);
     if (arg == -1) break;
 
-    if (found_scan_type) {
+    // Only one search type can be given.
+    if (found_scan_type && (arg == 'v' || arg == 'n' || arg == 's')) {
       options->scan_type = ScanOptions::ScanType::kBadOption;
       break;
     }
@@ -749,6 +1091,17 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
       case 'r':
         options->recursive_scan = true;
         break;
+      case 'b':
+        options->recursive_scan = true;
+        options->breadth_first = true;
+        break;
+      case 'd':
+        if (!ParseNumericOption(optarg, 0, &options->max_depth)) return nullptr;
+        break;
+      case 'c':
+        if (!ParseNumericOption(optarg, 0, &options->max_children))
+          return nullptr;
+        break;
       case 'v':
         options->scan_type = ScanOptions::ScanType::kFieldValue;
         found_scan_type = true;
@@ -767,61 +1120,95 @@ char** FindReferencesCmd::ParseScanOptions(char** cmd, ScanOptions* options) {
     }
   } while (true);
 
+  // getopt_long moves the operands after the options, return them in that
+  // order.
+  for (int i = 0; i < argc - 1; i++) cmd[i] = args[i + 1];
   return &cmd[optind - 1];
 }
 
-// Walk all contexts previously stored and print search_value_
-// reference if it exists. Not all values are associated with
-// a context object. It seems that Function-Local variables are
-// stored in the stack, and when some nested closure references
-// it is allocated in a Context object.
+// Print the contexts referring to search_value_. Not all values are
+// associated with a context object. It seems that Function-Local variables
+// are stored in the stack, and when some nested closure references it is
+// allocated in a Context object.
 void FindReferencesCmd::ReferenceScanner::PrintContextRefs(
     SBCommandReturnObject& result, Error& err, FindReferencesCmd* cli_cmd_,
-    ScanOptions* options, ReferencesVector* already_visited_references,
-    int level) {
-  ContextVector* contexts = llscan_->GetContexts();
-  v8::LLV8* v8 = llscan_->v8();
+    ScanOptions* options, AddressSet* already_visited_references, int level) {
+  const ReferenceGraph& graph = llscan_->GetReferenceGraph();
+
+  size_t begin, end;
+  graph.FindEdges(search_value_.raw(), &begin, &end);
+  for (size_t edge = begin; edge < end; edge++) {
+    if (graph.GetKind(edge) != ReferenceGraph::kContextVariable) continue;
+    PrintEdges(result, llscan_, graph, search_value_.raw(), edge, edge + 1,
+               "");
+
+    if (options->recursive_scan) {
+      cli_cmd_->PrintRecursiveReferences(result, options,
+                                         already_visited_references,
+                                         graph.GetSource(edge), level);
+    }
+  }
+}
+
 
-  for (auto ctx : *contexts) {
+void FindReferencesCmd::ReferenceScanner::PrintEdges(
+    SBCommandReturnObject& result, LLScan* llscan, const ReferenceGraph& graph,
+    uint64_t target, size_t begin, size_t end, const std::string& indent) {
+  static const char* const kFieldNames[] = {"<Parent>", "<First>", "<Second>",
+                                            "<Actual>"};
+  v8::LLV8* v8 = llscan->v8();
+
+  for (size_t edge = begin; edge < end; edge++) {
     Error err;
-    v8::HeapObject context_obj(v8, ctx);
-    v8::Context c(context_obj);
+    uint64_t source = graph.GetSource(edge);
+    uint32_t payload = graph.GetPayload(edge);
+    result.Printf("%s", indent.c_str());
+
+    if (graph.GetKind(edge) == ReferenceGraph::kContextVariable) {
+      std::string name = "???";
+      if (payload != ReferenceGraph::kUnknownPayload) {
+        v8::String _name(v8, graph.GetName(payload));
+        std::string maybe_name = _name.ToString(err);
+        if (err.Success())
+          name = maybe_name;
+        else
+          PRINT_DEBUG("Couldn't get the variable name for 0x%" PRIx64
+                      " in context 0x%" PRIx64,
+                      target, source);
+      }
 
-    v8::Context::Locals locals(&c, err);
-    // If we can't read locals in this context, just go to the next.
-    if (err.Fail()) continue;
-
-    for (v8::Context::Locals::Iterator it = locals.begin(); it != locals.end();
-         it++) {
-      if ((*it).raw() == search_value_.raw()) {
-        std::string name = "???";
-        v8::String _name = it.LocalName(err);
-        // TODO(mmarchini): use Check once #294 gets merged
-        if (err.Success()) {
-          std::string maybe_name = _name.ToString(err);
-          if (err.Success())
-            name = maybe_name;
-          else
-            PRINT_DEBUG("Couldn't get the variable name for 0x%" PRIx64
-                        " in context 0x%" PRIx64,
-                        search_value_.raw(), c.raw());
-        }
+      std::stringstream ss;
+      ss << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << ": "
+         << rang::fg::magenta << "Context" << rang::style::bold
+         << rang::fg::yellow << ".%s" << rang::fg::reset << rang::style::reset
+         << "=" << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << "\n";
 
-        std::stringstream ss;
-        ss << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << ": "
-           << rang::fg::magenta << "Context" << rang::style::bold
-           << rang::fg::yellow << ".%s" << rang::fg::reset << rang::style::reset
-           << "=" << rang::fg::cyan << "0x%" PRIx64 << rang::fg::reset << "\n";
+      result.Printf(ss.str().c_str(), source, name.c_str(), target);
+      continue;
+    }
 
-        result.Printf(ss.str().c_str(), c.raw(), name.c_str(),
-                      search_value_.raw());
+    v8::HeapObject source_obj(v8, source);
+    std::string type_name = source_obj.GetTypeName(err);
 
-        if (options->recursive_scan) {
-          cli_cmd_->PrintRecursiveReferences(
-              result, options, already_visited_references, c.raw(), level);
-        }
-      }
+    if (graph.GetKind(edge) == ReferenceGraph::kElement) {
+      int64_t index = payload;
+      std::string reference_template(GetArrayReferenceString());
+      result.Printf(reference_template.c_str(), source, type_name.c_str(),
+                    index, target);
+      continue;
+    }
+
+    std::string key;
+    if (graph.GetKind(edge) == ReferenceGraph::kInternal) {
+      key = kFieldNames[payload];
+    } else if (payload != ReferenceGraph::kUnknownPayload) {
+      v8::Value name(v8, graph.GetName(payload));
+      key = name.ToString(err);
     }
+
+    std::string reference_template(GetPropertyReferenceString());
+    result.Printf(reference_template.c_str(), source, type_name.c_str(),
+                  key.c_str(), target);
   }
 }
 
@@ -849,115 +1236,103 @@ std::string FindReferencesCmd::ObjectScanner::GetArrayReferenceString(
 void FindReferencesCmd::ReferenceScanner::PrintRefs(
     SBCommandReturnObject& result, v8::JSObject& js_obj, Error& err,
     int level) {
-  int64_t length = js_obj.GetArrayLength(err);
-  for (int64_t i = 0; i < length; ++i) {
-    v8::Value v = js_obj.GetArrayElement(i, err);
+  size_t begin, end;
+  FindEdges(js_obj.raw(), &begin, &end);
+  PrintEdges(result, llscan_, llscan_->GetReferenceGraph(),
+             search_value_.raw(), begin, end, "");
+}
 
-    // Array is borked, or not array at all - skip it
-    if (!err.Success()) break;
 
-    if (v.raw() != search_value_.raw()) continue;
+void FindReferencesCmd::ReferenceScanner::PrintRefs(
+    SBCommandReturnObject& result, v8::String& str, Error& err, int level) {
+  // Concatenated, sliced and thin strings refer to other strings.
+  size_t begin, end;
+  FindEdges(str.raw(), &begin, &end);
+  PrintEdges(result, llscan_, llscan_->GetReferenceGraph(),
+             search_value_.raw(), begin, end, "");
+}
 
-    std::string type_name = js_obj.GetTypeName(err);
 
-    std::string reference_template(GetArrayReferenceString(level));
-    result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
-                  i, search_value_.raw());
-  }
+bool FindReferencesCmd::ReferenceScanner::AreReferencesLoaded() {
+  return llscan_->GetReferenceGraph().IsLoaded();
+}
 
-  // Walk all the properties in this object.
-  // We only create strings for the field names that match the search
-  // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
-  if (err.Fail()) {
-    return;
-  }
-  for (auto entry : entries) {
-    v8::Value v = entry.second;
-    if (v.raw() == search_value_.raw()) {
-      std::string key = entry.first.ToString(err);
-      std::string type_name = js_obj.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
+void FindReferencesCmd::ReferenceScanner::LoadReferences(
+    FindReferencesCmd* cli_cmd) {
+  llscan_->BuildReferenceGraph();
+}
+
 
-      result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
-                    key.c_str(), search_value_.raw());
+ReferencesVector* FindReferencesCmd::ReferenceScanner::GetReferences() {
+  const ReferenceGraph& graph = llscan_->GetReferenceGraph();
+  references_.clear();
+  edges_.clear();
+
+  size_t begin, end;
+  graph.FindEdges(search_value_.raw(), &begin, &end);
+  for (size_t edge = begin; edge < end; edge++) {
+    if (graph.GetKind(edge) == ReferenceGraph::kContextVariable) continue;
+
+    // The edges of a source are next to each other.
+    uint64_t source = graph.GetSource(edge);
+    if (references_.empty() || references_.back() != source) {
+      references_.push_back(source);
+      edges_[source] = std::make_pair(edge, edge + 1);
+    } else {
+      edges_[source].second = edge + 1;
     }
   }
+  return &references_;
 }
 
 
-void FindReferencesCmd::ReferenceScanner::PrintRefs(
-    SBCommandReturnObject& result, v8::String& str, Error& err, int level) {
-  v8::LLV8* v8 = str.v8();
-
-  v8::CheckedType<int64_t> repr = str.Representation(err);
-  RETURN_IF_INVALID(repr, );
-
-  // Concatenated and sliced strings refer to other strings so
-  // we need to check their references.
-  if (*repr == v8->string()->kSlicedStringTag) {
-    v8::SlicedString sliced_str(str);
-    v8::String parent = sliced_str.Parent(err);
-    if (err.Success() && parent.raw() == search_value_.raw()) {
-      std::string type_name = sliced_str.GetTypeName(err);
-
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Parent>", search_value_.raw());
-    }
-  } else if (*repr == v8->string()->kConsStringTag) {
-    v8::ConsString cons_str(str);
-
-    v8::String first = cons_str.First(err);
-    if (err.Success() && first.raw() == search_value_.raw()) {
-      std::string type_name = cons_str.GetTypeName(err);
+void FindReferencesCmd::ReferenceScanner::FindEdges(uint64_t source,
+                                                    size_t* begin,
+                                                    size_t* end) {
+  auto it = edges_.find(source);
+  if (it == edges_.end()) {
+    *begin = *end = 0;
+    return;
+  }
+  *begin = it->second.first;
+  *end = it->second.second;
+}
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<First>", search_value_.raw());
-    }
 
-    v8::String second = cons_str.Second(err);
-    if (err.Success() && second.raw() == search_value_.raw()) {
-      std::string type_name = cons_str.GetTypeName(err);
+void FindReferencesCmd::PropertyScanner::PrintRefs(
+    SBCommandReturnObject& result, v8::JSObject& js_obj, Error& err,
+    int level) {
+  // (Note: We skip array elements as they don't have names.)
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Second>", search_value_.raw());
+  // Walk all the properties in this object.
+  // We only create strings for the field names that match the search
+  // value.
+  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  if (err.Fail()) {
+    return;
+  }
+  for (auto entry : entries) {
+    v8::HeapObject nameObj(entry.first);
+    std::string key = entry.first.ToString(err);
+    if (err.Fail()) {
+      continue;
     }
-  } else if (*repr == v8->string()->kThinStringTag) {
-    v8::ThinString thin_str(str);
-    v8::String actual = thin_str.Actual(err);
-    if (err.Success() && actual.raw() == search_value_.raw()) {
-      std::string type_name = thin_str.GetTypeName(err);
+    if (key == search_value_) {
+      std::string type_name = js_obj.GetTypeName(err);
 
-      std::string reference_template(GetPropertyReferenceString(level));
-      result.Printf(reference_template.c_str(), str.raw(), type_name.c_str(),
-                    "<Actual>", search_value_.raw());
+      std::string reference_template(GetPropertyReferenceString());
+      result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
+                    key.c_str(), entry.second.raw());
     }
   }
-  // Nothing to do for other kinds of string.
 }
 
 
-void FindReferencesCmd::ReferenceScanner::ScanRefs(v8::JSObject& js_obj,
-                                                   Error& err) {
-  ReferencesVector* references;
-  std::set<uint64_t> already_saved;
-
-  int64_t length = js_obj.GetArrayLength(err);
-  for (int64_t i = 0; i < length; ++i) {
-    v8::Value v = js_obj.GetArrayElement(i, err);
-
-    // Array is borked, or not array at all - skip it
-    if (!err.Success()) break;
-    if (already_saved.count(v.raw())) continue;
-
-    references = llscan_->GetReferencesByValue(v.raw());
-    references->push_back(js_obj.raw());
-    already_saved.insert(v.raw());
-  }
+void FindReferencesCmd::PropertyScanner::ScanRefs(v8::JSObject& js_obj,
+                                                  ReferenceBucket& bucket,
+                                                  Error& err) {
+  // (Note: We skip array elements as they don't have names.)
 
   // Walk all the properties in this object.
   // We only create strings for the field names that match the search
@@ -967,137 +1342,33 @@ void FindReferencesCmd::ReferenceScanner::ScanRefs(v8::JSObject& js_obj,
     return;
   }
   for (auto entry : entries) {
-    v8::Value v = entry.second;
+    v8::HeapObject nameObj(entry.first);
+    std::string key = entry.first.ToString(err);
+    if (err.Fail()) {
+      continue;
+    }
+    bucket.properties.emplace_back(std::move(key), js_obj.raw());
+  }
+}
 
-    if (already_saved.count(v.raw())) continue;
 
-    references = llscan_->GetReferencesByValue(v.raw());
-    references->push_back(js_obj.raw());
-    already_saved.insert(v.raw());
+void FindReferencesCmd::PropertyScanner::MergeRefs(ReferenceBucket& bucket) {
+  for (auto& reference : bucket.properties) {
+    ReferencesVector* references =
+        llscan_->GetReferencesByProperty(reference.first);
+    references->push_back(reference.second);
   }
 }
 
 
-void FindReferencesCmd::ReferenceScanner::ScanRefs(v8::String& str,
-                                                   Error& err) {
-  ReferencesVector* references;
-  std::set<uint64_t> already_saved;
+bool FindReferencesCmd::PropertyScanner::AreReferencesLoaded() {
+  return llscan_->AreReferencesByPropertyLoaded();
+}
 
-  v8::LLV8* v8 = str.v8();
 
-  v8::CheckedType<int64_t> repr = str.Representation(err);
-  RETURN_IF_INVALID(repr, );
-
-  // Concatenated and sliced strings refer to other strings so
-  // we need to check their references.
-
-  if (*repr == v8->string()->kSlicedStringTag) {
-    v8::SlicedString sliced_str(str);
-    v8::String parent = sliced_str.Parent(err);
-
-    if (err.Success()) {
-      references = llscan_->GetReferencesByValue(parent.raw());
-      references->push_back(str.raw());
-    }
-
-  } else if (*repr == v8->string()->kConsStringTag) {
-    v8::ConsString cons_str(str);
-
-    v8::String first = cons_str.First(err);
-    if (err.Success()) {
-      references = llscan_->GetReferencesByValue(first.raw());
-      references->push_back(str.raw());
-    }
-
-    v8::String second = cons_str.Second(err);
-    if (err.Success() && first.raw() != second.raw()) {
-      references = llscan_->GetReferencesByValue(second.raw());
-      references->push_back(str.raw());
-    }
-  } else if (*repr == v8->string()->kThinStringTag) {
-    v8::ThinString thin_str(str);
-    v8::String actual = thin_str.Actual(err);
-
-    if (err.Success()) {
-      references = llscan_->GetReferencesByValue(actual.raw());
-      references->push_back(str.raw());
-    }
-  }
-  // Nothing to do for other kinds of string.
-}
-
-
-bool FindReferencesCmd::ReferenceScanner::AreReferencesLoaded() {
-  return llscan_->AreReferencesByValueLoaded();
-}
-
-
-ReferencesVector* FindReferencesCmd::ReferenceScanner::GetReferences() {
-  return llscan_->GetReferencesByValue(search_value_.raw());
-}
-
-
-void FindReferencesCmd::PropertyScanner::PrintRefs(
-    SBCommandReturnObject& result, v8::JSObject& js_obj, Error& err,
-    int level) {
-  // (Note: We skip array elements as they don't have names.)
-
-  // Walk all the properties in this object.
-  // We only create strings for the field names that match the search
-  // value.
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
-  if (err.Fail()) {
-    return;
-  }
-  for (auto entry : entries) {
-    v8::HeapObject nameObj(entry.first);
-    std::string key = entry.first.ToString(err);
-    if (err.Fail()) {
-      continue;
-    }
-    if (key == search_value_) {
-      std::string type_name = js_obj.GetTypeName(err);
-
-      std::string reference_template(GetPropertyReferenceString());
-      result.Printf(reference_template.c_str(), js_obj.raw(), type_name.c_str(),
-                    key.c_str(), entry.second.raw());
-    }
-  }
-}
-
-
-void FindReferencesCmd::PropertyScanner::ScanRefs(v8::JSObject& js_obj,
-                                                  Error& err) {
-  // (Note: We skip array elements as they don't have names.)
-
-  // Walk all the properties in this object.
-  // We only create strings for the field names that match the search
-  // value.
-  ReferencesVector* references;
-  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
-  if (err.Fail()) {
-    return;
-  }
-  for (auto entry : entries) {
-    v8::HeapObject nameObj(entry.first);
-    std::string key = entry.first.ToString(err);
-    if (err.Fail()) {
-      continue;
-    }
-    references = llscan_->GetReferencesByProperty(key);
-    references->push_back(js_obj.raw());
-  }
-}
-
-
-bool FindReferencesCmd::PropertyScanner::AreReferencesLoaded() {
-  return llscan_->AreReferencesByPropertyLoaded();
-}
-
-
-ReferencesVector* FindReferencesCmd::PropertyScanner::GetReferences() {
-  return llscan_->GetReferencesByProperty(search_value_);
-}
+ReferencesVector* FindReferencesCmd::PropertyScanner::GetReferences() {
+  return llscan_->GetReferencesByProperty(search_value_);
+}
 
 
 void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
@@ -1119,11 +1390,11 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
     }
     if (type < v8->types()->kFirstNonstringType) {
       v8::String valueString(valueObj);
-      std::string value = valueString.ToString(err);
+      bool match = valueString.Equals(search_value_, err);
       if (err.Fail()) {
         continue;
       }
-      if (err.Success() && search_value_ == value) {
+      if (match) {
         std::string type_name = js_obj.GetTypeName(err);
 
         std::stringstream ss;
@@ -1132,7 +1403,7 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
 
         result.Printf("%s: %s[%" PRId64 "]=0x%" PRIx64 " '%s'\n",
                       ss.str().c_str(), type_name.c_str(), i, v.raw(),
-                      value.c_str());
+                      search_value_.c_str());
       }
     }
   }
@@ -1150,11 +1421,11 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
       }
       if (type < v8->types()->kFirstNonstringType) {
         v8::String valueString(valueObj);
-        std::string value = valueString.ToString(err);
+        bool match = valueString.Equals(search_value_, err);
         if (err.Fail()) {
           continue;
         }
-        if (search_value_ == value) {
+        if (match) {
           std::string key = entry.first.ToString(err);
           if (err.Fail()) {
             continue;
@@ -1166,7 +1437,7 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
              << rang::fg::reset << ": " << type_name.c_str() << "."
              << key.c_str() << "=" << rang::fg::cyan << "0x" << std::hex
              << entry.second.raw() << std::dec << rang::fg::reset << " '"
-             << value.c_str() << "'" << std::endl;
+             << search_value_.c_str() << "'" << std::endl;
 
           result.Printf("%s", ss.str().c_str());
         }
@@ -1191,12 +1462,12 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
     v8::SlicedString sliced_str(str);
     v8::String parent_str = sliced_str.Parent(err);
     if (err.Fail()) return;
-    std::string parent = parent_str.ToString(err);
-    if (err.Success() && search_value_ == parent) {
+    bool match = parent_str.Equals(search_value_, err);
+    if (err.Success() && match) {
       std::string type_name = sliced_str.GetTypeName(err);
       result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
                     type_name.c_str(), "<Parent>", parent_str.raw(),
-                    parent.c_str());
+                    search_value_.c_str());
     }
   } else if (*repr == v8->string()->kConsStringTag) {
     v8::ConsString cons_str(str);
@@ -1211,13 +1482,13 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
     if (err.Fail()) return;
 
     if (first_type < v8->types()->kFirstNonstringType) {
-      std::string first = first_str.ToString(err);
+      bool match = first_str.Equals(search_value_, err);
 
-      if (err.Success() && search_value_ == first) {
+      if (err.Success() && match) {
         std::string type_name = cons_str.GetTypeName(err);
         result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
                       type_name.c_str(), "<First>", first_str.raw(),
-                      first.c_str());
+                      search_value_.c_str());
       }
     }
 
@@ -1231,13 +1502,13 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
     if (err.Fail()) return;
 
     if (second_type < v8->types()->kFirstNonstringType) {
-      std::string second = second_str.ToString(err);
+      bool match = second_str.Equals(search_value_, err);
 
-      if (err.Success() && search_value_ == second) {
+      if (err.Success() && match) {
         std::string type_name = cons_str.GetTypeName(err);
         result.Printf("0x%" PRIx64 ": %s.%s=0x%" PRIx64 " '%s'\n", str.raw(),
                       type_name.c_str(), "<Second>", second_str.raw(),
-                      second.c_str());
+                      search_value_.c_str());
       }
     }
   }
@@ -1247,10 +1518,10 @@ void FindReferencesCmd::StringScanner::PrintRefs(SBCommandReturnObject& result,
 
 
 void FindReferencesCmd::StringScanner::ScanRefs(v8::JSObject& js_obj,
+                                                ReferenceBucket& bucket,
                                                 Error& err) {
   v8::LLV8* v8 = js_obj.v8();
-  ReferencesVector* references;
-  std::set<std::string> already_saved;
+  std::unordered_set<uint64_t> already_saved;
 
   int64_t length = js_obj.GetArrayLength(err);
   for (int64_t i = 0; i < length; ++i) {
@@ -1266,16 +1537,15 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::JSObject& js_obj,
     }
     if (type < v8->types()->kFirstNonstringType) {
       v8::String valueString(valueObj);
-      std::string value = valueString.ToString(err);
+      uint64_t hash = valueString.Hash(err);
       if (err.Fail()) {
         continue;
       }
 
-      if (already_saved.count(value)) continue;
+      if (already_saved.count(hash)) continue;
 
-      references = llscan_->GetReferencesByString(value);
-      references->push_back(js_obj.raw());
-      already_saved.insert(value);
+      bucket.strings.emplace_back(hash, js_obj.raw());
+      already_saved.insert(hash);
     }
   }
 
@@ -1292,24 +1562,24 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::JSObject& js_obj,
       }
       if (type < v8->types()->kFirstNonstringType) {
         v8::String valueString(valueObj);
-        std::string value = valueString.ToString(err);
+        uint64_t hash = valueString.Hash(err);
         if (err.Fail()) {
           continue;
         }
-        if (already_saved.count(value)) continue;
+        if (already_saved.count(hash)) continue;
 
-        references = llscan_->GetReferencesByString(value);
-        references->push_back(js_obj.raw());
-        already_saved.insert(value);
+        bucket.strings.emplace_back(hash, js_obj.raw());
+        already_saved.insert(hash);
       }
     }
   }
 }
 
 
-void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str, Error& err) {
+void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str,
+                                                ReferenceBucket& bucket,
+                                                Error& err) {
   v8::LLV8* v8 = str.v8();
-  ReferencesVector* references;
 
   // Concatenated and sliced strings refer to other strings so
   // we need to check their references.
@@ -1321,10 +1591,9 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str, Error& err) {
     v8::SlicedString sliced_str(str);
     v8::String parent_str = sliced_str.Parent(err);
     if (err.Fail()) return;
-    std::string parent = parent_str.ToString(err);
+    uint64_t hash = parent_str.Hash(err);
     if (err.Success()) {
-      references = llscan_->GetReferencesByString(parent);
-      references->push_back(str.raw());
+      bucket.strings.emplace_back(hash, str.raw());
     }
   } else if (*repr == v8->string()->kConsStringTag) {
     v8::ConsString cons_str(str);
@@ -1339,11 +1608,10 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str, Error& err) {
     if (err.Fail()) return;
 
     if (first_type < v8->types()->kFirstNonstringType) {
-      std::string first = first_str.ToString(err);
+      uint64_t hash = first_str.Hash(err);
 
       if (err.Success()) {
-        references = llscan_->GetReferencesByString(first);
-        references->push_back(str.raw());
+        bucket.strings.emplace_back(hash, str.raw());
       }
     }
 
@@ -1357,11 +1625,10 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str, Error& err) {
     if (err.Fail()) return;
 
     if (second_type < v8->types()->kFirstNonstringType) {
-      std::string second = second_str.ToString(err);
+      uint64_t hash = second_str.Hash(err);
 
       if (err.Success()) {
-        references = llscan_->GetReferencesByString(second);
-        references->push_back(str.raw());
+        bucket.strings.emplace_back(hash, str.raw());
       }
     }
   }
@@ -1370,167 +1637,967 @@ void FindReferencesCmd::StringScanner::ScanRefs(v8::String& str, Error& err) {
 }
 
 
+void FindReferencesCmd::StringScanner::MergeRefs(ReferenceBucket& bucket) {
+  for (auto& reference : bucket.strings) {
+    ReferencesVector* references =
+        llscan_->GetReferencesByString(reference.first);
+    references->push_back(reference.second);
+  }
+}
+
+
 bool FindReferencesCmd::StringScanner::AreReferencesLoaded() {
   return llscan_->AreReferencesByStringLoaded();
 }
 
 
 ReferencesVector* FindReferencesCmd::StringScanner::GetReferences() {
-  return llscan_->GetReferencesByString(search_value_);
+  // Strings are bucketed by hash, PrintRefs() drops the collisions.
+  return llscan_->GetReferencesByString(v8::StringView::Hash(search_value_));
 }
 
 
-FindJSObjectsVisitor::FindJSObjectsVisitor(SBTarget& target, LLScan* llscan)
-    : target_(target), llscan_(llscan) {
-  found_count_ = 0;
-  address_byte_size_ = target_.GetProcess().GetAddressByteSize();
-}
+bool FindRootsCmd::DoExecute(SBDebugger d, char** cmd,
+                             SBCommandReturnObject& result) {
+  if (cmd == nullptr || *cmd == nullptr) {
+    result.SetError("USAGE: v8 findroots [flags] expr\n");
+    return false;
+  }
 
+  SBTarget target = d.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.SetError("No valid process, please start something\n");
+    return false;
+  }
 
-/* Visit every address, a bit brute force but it works. */
-uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
-  v8::Value v8_value(llscan_->v8(), word);
+  // Load V8 constants from postmortem data
+  llscan_->v8()->Load(target);
 
-  Error err;
-  // Test if this is SMI
-  // Skip inspecting things that look like Smi's, they aren't objects.
-  v8::Smi smi(v8_value);
-  if (smi.Check()) return address_byte_size_;
+  Options options;
+  char** start = ParseOptions(cmd, &options);
+  if (start == nullptr) {
+    result.SetError("Invalid option");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+  if (*start == nullptr) {
+    result.SetError("Missing search parameter");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
 
-  v8::HeapObject heap_object(v8_value);
-  if (!heap_object.Check()) return address_byte_size_;
+  std::string full_cmd;
+  for (; *start != nullptr; start++) full_cmd += *start;
 
-  v8::HeapObject map_object = heap_object.GetMap(err);
-  if (err.Fail() || !map_object.Check()) return address_byte_size_;
+  SBExpressionOptions expr_options;
+  SBValue value = target.EvaluateExpression(full_cmd.c_str(), expr_options);
+  if (value.GetError().Fail()) {
+    SBError error = value.GetError();
+    result.SetError(error);
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+  v8::Value search_value(llscan_->v8(), value.GetValueAsSigned());
+  v8::Smi smi(search_value);
+  if (smi.Check()) {
+    result.SetError("Search value is an SMI.");
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
 
-  v8::Map map(map_object);
+  if (!llscan_->ScanHeapForObjects(target, result)) {
+    result.SetStatus(eReturnStatusFailed);
+    return false;
+  }
+  if (!llscan_->GetReferenceGraph().IsLoaded()) llscan_->BuildReferenceGraph();
 
-  MapCacheEntry map_info;
-  if (map_cache_.count(map.raw()) == 0) {
-    map_info.Load(map, heap_object, llscan_->v8(), err);
-    if (err.Fail()) {
-      return address_byte_size_;
-    }
-    // Cache result
-    map_cache_.emplace(map.raw(), map_info);
+  RootMap roots;
+  ReferenceGraph root_edges;
+  LoadRoots(target, &roots, &root_edges);
+
+  uint64_t address = search_value.raw();
+  auto root = roots.find(address);
+  if (root != roots.end()) {
+    result.Printf("0x%" PRIx64 " is a %s\n", address,
+                  GetRootName(root->second));
   } else {
-    map_info = map_cache_.at(map.raw());
+    PrintPaths(result, options, roots, root_edges, address);
   }
 
-  if (map_info.is_context) {
-    InsertOnContexts(word, err);
-    return address_byte_size_;
-  }
+  result.SetStatus(eReturnStatusSuccessFinishResult);
+  return true;
+}
 
-  if (!map_info.is_histogram) return address_byte_size_;
 
-  InsertOnMapsToInstances(word, map, map_info, err);
-  InsertOnDetailedMapsToInstances(word, map, map_info, err);
+char** FindRootsCmd::ParseOptions(char** cmd, Options* options) {
+  static struct option opts[] = {{"max-paths", required_argument, nullptr, 'k'},
+                                 {"max-depth", required_argument, nullptr, 'd'},
+                                 {"timeout", required_argument, nullptr, 't'},
+                                 {nullptr, 0, nullptr, 0}};
 
-  if (err.Fail()) {
-    return address_byte_size_;
-  }
+  int argc = 1;
+  for (char** p = cmd; p != nullptr && *p != nullptr; p++) argc++;
 
-  found_count_++;
+  char* args[argc];
 
-  /* Just advance one word.
-   * (Should advance by object size, assuming objects can't overlap!)
-   */
-  return address_byte_size_;
-}
+  // Make this look like a command line, we need a valid element at index 0
+  // for getopt_long to use in its error messages.
+  char name[] = "llscan";
+  args[0] = name;
+  for (int i = 0; i < argc - 1; i++) args[i + 1] = cmd[i];
 
-void FindJSObjectsVisitor::InsertOnContexts(uint64_t word, Error& err) {
-  ContextVector* contexts;
-  contexts = llscan_->GetContexts();
-  contexts->insert(word);
+  // Reset getopts.
+  optind = 0;
+  opterr = 1;
+  do {
+    int arg = getopt_long(argc, args, "k:d:t:", opts, nullptr);
+    if (arg == -1) break;
+
+    switch (arg) {
+      case 'k':
+        if (!ParseNumericOption(optarg, 1, &options->max_paths)) return nullptr;
+        break;
+      case 'd':
+        if (!ParseNumericOption(optarg, 0, &options->max_depth)) return nullptr;
+        break;
+      case 't':
+        if (!ParseNumericOption(optarg, 0, &options->timeout)) return nullptr;
+        break;
+      default:
+        return nullptr;
+    }
+  } while (true);
+
+  // getopt_long moves the operands after the options, return them in that
+  // order.
+  for (int i = 0; i < argc - 1; i++) cmd[i] = args[i + 1];
+  return &cmd[optind - 1];
 }
 
-void FindJSObjectsVisitor::InsertOnMapsToInstances(
-    uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
-    Error& err) {
-  TypeRecord* t;
 
-  auto entry = std::make_pair(map_info.type_name, nullptr);
-  auto pp = &llscan_->GetMapsToInstances().insert(entry).first->second;
-  // No entry in the map, create a new one.
-  if (*pp == nullptr) *pp = new TypeRecord(map_info.type_name);
-  t = *pp;
-  t->AddInstance(word, map.InstanceSize(err));
+const char* FindRootsCmd::GetRootName(RootKind kind) {
+  switch (kind) {
+    case kNativeContext:
+      return "native context";
+    case kGlobalObject:
+      return "global object";
+    case kHandleWrap:
+      return "handle wrap";
+    case kReqWrap:
+      return "request wrap";
+  }
+  return "root";
 }
 
-void FindJSObjectsVisitor::InsertOnDetailedMapsToInstances(
-    uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
-    Error& err) {
-  DetailedTypeRecord* t;
 
-  auto type_name_with_properties = map_info.GetTypeNameWithProperties();
+template <class Queue>
+static void AddWrapRoots(const Queue& queue, FindRootsCmd::RootKind kind,
+                         FindRootsCmd::RootMap* roots) {
+  for (auto w : queue) {
+    Error err;
+    addr_t persistent = w.Persistent(err);
+    if (err.Fail()) break;
+    if (persistent == 0) continue;
 
-  auto entry = std::make_pair(type_name_with_properties, nullptr);
-  auto pp = &llscan_->GetDetailedMapsToInstances().insert(entry).first->second;
-  // No entry in the map, create a new one.
-  if (*pp == nullptr) {
-    auto type_name_with_three_properties = map_info.GetTypeNameWithProperties(
-        MapCacheEntry::kDontShowArrayLength,
-        kNumberOfPropertiesForDetailedOutput);
-    *pp = new DetailedTypeRecord(type_name_with_three_properties,
-                                 map_info.own_descriptors_count_,
-                                 map_info.indexed_properties_count_);
+    addr_t object = w.Object(err);
+    if (err.Fail()) break;
+    (*roots)[object] = kind;
   }
-  t = *pp;
-  t->AddInstance(word, map.InstanceSize(err));
 }
 
 
-bool FindJSObjectsVisitor::IsAHistogramType(v8::Map& map, Error& err) {
-  int64_t type = map.GetType(err);
-  if (err.Fail()) return false;
+void FindRootsCmd::LoadRoots(SBTarget target, RootMap* roots,
+                             ReferenceGraph* root_edges) {
+  v8::LLV8* v8 = llscan_->v8();
+  int64_t global_index = v8->context()->kGlobalObjectIndex;
+  std::vector<ReferenceGraph::Reference> bucket;
 
-  v8::LLV8* v8 = map.v8();
-  if (v8::JSObject::IsObjectType(v8, type)) return true;
-  if (type == v8->types()->kJSArrayType) return true;
-  if (type == v8->types()->kJSTypedArrayType) return true;
-  if (type < v8->types()->kFirstNonstringType) return true;
-  return false;
+  for (uint64_t context : *llscan_->GetContexts()) {
+    Error err;
+    v8::HeapObject context_obj(v8, context);
+    v8::Context c(context_obj);
+    if (!c.IsNative(err)) continue;
+    (*roots)[context] = kNativeContext;
+
+    // Native contexts hold the builtins, the global proxy and whatever
+    // embedders put there in their slots, which appear as elements.
+    v8::Smi length = c.Length(err);
+    int64_t slots = err.Success() ? length.GetValue() : 0;
+    for (int64_t slot = 0; slot < slots; slot++) {
+      v8::Value value = c.Get<v8::Value>(slot, err);
+      if (err.Fail()) break;
+      if (v8::Smi(value).Check()) continue;
+      bucket.push_back({context, static_cast<uint64_t>(value.raw()),
+                        static_cast<uint64_t>(slot), ReferenceGraph::kElement});
+    }
+
+    if (global_index == -1) continue;
+
+    // Global objects aren't in the instance lists, so their properties are
+    // only found here. They are read from the PropertyCells of the global
+    // dictionary.
+    v8::HeapObject global = c.Get<v8::HeapObject>(global_index, err);
+    if (err.Fail() || !global.Check()) continue;
+    int64_t type = global.GetType(err);
+    if (err.Fail() || type != v8->types()->kGlobalObjectType) {
+      PRINT_DEBUG("No global object in native context 0x%" PRIx64, context);
+      continue;
+    }
+    (*roots)[global.raw()] = kGlobalObject;
+    v8::JSObject js_obj(global);
+    llscan_->AddObjectReferences(js_obj, bucket);
+  }
+  for (const ReferenceGraph::Reference& reference : bucket)
+    root_edges->AddReference(reference);
+  root_edges->Finalize();
+
+  Error err;
+  node_->Load(target);
+  node::Environment env = node::Environment::GetCurrent(node_, err);
+  if (err.Fail()) {
+    PRINT_DEBUG("No Environment, handle and request wraps aren't roots");
+    return;
+  }
+  AddWrapRoots(env.handle_wrap_queue(), kHandleWrap, roots);
+  AddWrapRoots(env.req_wrap_queue(), kReqWrap, roots);
 }
 
 
-bool LLScan::ScanHeapForObjects(lldb::SBTarget target,
-                                lldb::SBCommandReturnObject& result) {
-  /* Check the last scan is still valid - the process hasn't moved
-   * and we haven't changed target.
-   */
+void FindRootsCmd::PrintPaths(SBCommandReturnObject& result,
+                              const Options& options, const RootMap& roots,
+                              const ReferenceGraph& root_edges,
+                              uint64_t address) {
+  static const uint32_t kNoStep = AddressIndex::kNotFound;
+  static const size_t kEdgesPerClockCheck = 4096;
+
+  // A value found by the search and the edge from it to the value one step
+  // closer to `address`.
+  struct Step {
+    uint64_t address;
+    uint32_t next;
+    uint32_t depth;
+    const ReferenceGraph* graph;
+    size_t edge;
+  };
+  // A path ends with an edge from a root to a step.
+  struct Path {
+    uint32_t step;
+    const ReferenceGraph* graph;
+    size_t edge;
+  };
+
+  const ReferenceGraph* graphs[] = {&llscan_->GetReferenceGraph(),
+                                    &root_edges};
+  size_t max_paths = options.max_paths;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> timeout(options.timeout);
+
+  // Breadth first from `address` over the reverse references. Every value
+  // is visited once, so the path to each step is a shortest one. Roots are
+  // never visited, every edge into one ends a path instead: the paths come
+  // out shortest first, and a root holding the value through different
+  // referrers shows up once for each.
+  std::vector<Step> steps;
+  AddressIndex step_ids;
+  std::vector<Path> paths;
+  steps.push_back({address, kNoStep, 0, nullptr, 0});
+  step_ids.Insert(address, 0);
+
+  bool timed_out = false;
+  size_t head = 0;
+  size_t edges_visited = 0;
+  for (; head < steps.size() && paths.size() < max_paths && !timed_out;
+       head++) {
+    // push_back() below may move the step.
+    uint64_t current = steps[head].address;
+    uint32_t depth = steps[head].depth;
+    if (options.max_depth > 0 &&
+        depth >= static_cast<uint32_t>(options.max_depth)) {
+      continue;
+    }
 
-  // Reload process anyway
-  process_ = target.GetProcess();
+    for (const ReferenceGraph* graph : graphs) {
+      size_t begin, end;
+      graph->FindEdges(current, &begin, &end);
+      for (size_t edge = begin; edge < end && paths.size() < max_paths;
+           edge = NextSource(*graph, edge, end)) {
+        // A single value can have millions of referrers, the clock is checked
+        // between edges rather than between values.
+        if (options.timeout > 0 && ++edges_visited % kEdgesPerClockCheck == 0 &&
+            std::chrono::steady_clock::now() - start > timeout) {
+          timed_out = true;
+          break;
+        }
 
-  // Need to reload memory regions.
-  if (target_ != target) {
-    ClearMapsToInstances();
-    ClearReferences();
-    target_ = target;
+        uint64_t source = graph->GetSource(edge);
+        if (roots.count(source) != 0) {
+          paths.push_back({static_cast<uint32_t>(head), graph, edge});
+          continue;
+        }
+        if (step_ids.Find(source) != AddressIndex::kNotFound) continue;
+        if (steps.size() >= kNoStep) continue;
+
+        step_ids.Insert(source, steps.size());
+        steps.push_back({source, static_cast<uint32_t>(head), depth + 1, graph,
+                         edge});
+      }
+      if (timed_out) break;
+    }
   }
 
-  /* If we've reached here we have access to information about the valid memory
-   * regions in the process and can scan for objects.
-   */
+  unsigned int padding = Settings::GetSettings()->GetTreePadding();
+  std::string indent(padding, ' ');
+  for (size_t i = 0; i < paths.size(); i++) {
+    const Path& path = paths[i];
+    uint64_t root = path.graph->GetSource(path.edge);
+    result.Printf("Path %zu, %u references, held by %s 0x%" PRIx64 ":\n",
+                  i + 1, steps[path.step].depth + 1,
+                  GetRootName(roots.at(root)), root);
+
+    // From the root down to `address`: the edge from the root first, then
+    // the edge of each step to the value it holds.
+    struct Link {
+      const ReferenceGraph* graph;
+      size_t edge;
+      uint64_t target;
+    };
+    std::vector<Link> chain;
+    chain.push_back({path.graph, path.edge, steps[path.step].address});
+    for (uint32_t step = path.step; step != 0; step = steps[step].next) {
+      const Step& s = steps[step];
+      chain.push_back({s.graph, s.edge, steps[s.next].address});
+    }
 
-  /* Populate the map of objects. */
-  if (mapstoinstances_.empty()) {
-    FindJSObjectsVisitor v(target, this);
+    for (const Link& link : chain) {
+      FindReferencesCmd::ReferenceScanner::PrintEdges(
+          result, llscan_, *link.graph, link.target, link.edge, link.edge + 1,
+          indent);
+    }
+  }
 
-    ScanMemoryRegions(v);
+  if (timed_out) {
+    result.Printf(
+        "Search stopped after %d seconds with %zu values visited, use "
+        "--timeout to search longer\n",
+        options.timeout, head);
+  } else if (paths.empty()) {
+    result.Printf("No path to a root found, %zu values visited\n", head);
   }
+}
 
-  return true;
+
+void AddressSet::Insert(uint64_t address) {
+  // Keep the load factor under 1/2.
+  if ((size_ + 1) * 2 > slots_.size()) Grow();
+
+  size_t mask = slots_.size() - 1;
+  for (size_t i = HashSlot(address, shift_);; i = (i + 1) & mask) {
+    if (slots_[i] == address) return;
+    if (slots_[i] == 0) {
+      slots_[i] = address;
+      size_++;
+      return;
+    }
+  }
 }
 
-std::string FindJSObjectsVisitor::MapCacheEntry::GetTypeNameWithProperties(
-    ShowArrayLength show_array_length, size_t max_properties) {
-  std::string type_name_with_properties(type_name);
 
-  if (show_array_length == kShowArrayLength) {
-    type_name_with_properties +=
-        "[" + std::to_string(indexed_properties_count_) + "]";
+void AddressSet::Grow() {
+  std::vector<uint64_t> old_slots;
+  old_slots.swap(slots_);
+
+  slots_.assign(old_slots.empty() ? 64 : old_slots.size() * 2, 0);
+  shift_ = 64;
+  for (size_t n = slots_.size(); n > 1; n >>= 1) shift_--;
+
+  size_ = 0;
+  for (uint64_t address : old_slots) {
+    if (address != 0) Insert(address);
+  }
+}
+
+
+void AddressIndex::Insert(uint64_t address, uint32_t index) {
+  // Keep the load factor under 1/2.
+  if ((size_ + 1) * 2 > slots_.size()) Grow();
+
+  size_t mask = slots_.size() - 1;
+  for (size_t i = AddressSet::HashSlot(address, shift_);; i = (i + 1) & mask) {
+    if (slots_[i].address == address) {
+      slots_[i].index = index;
+      return;
+    }
+    if (slots_[i].address == 0) {
+      slots_[i] = {address, index};
+      size_++;
+      return;
+    }
+  }
+}
+
+
+void AddressIndex::Grow() {
+  std::vector<Slot> old_slots;
+  old_slots.swap(slots_);
+
+  slots_.assign(old_slots.empty() ? 64 : old_slots.size() * 2, {0, 0});
+  shift_ = 64;
+  for (size_t n = slots_.size(); n > 1; n >>= 1) shift_--;
+
+  size_ = 0;
+  for (const Slot& slot : old_slots) {
+    if (slot.address != 0) Insert(slot.address, slot.index);
+  }
+}
+
+
+void ReferenceGraph::AddReference(const Reference& reference) {
+  uint64_t payload = reference.payload;
+  if (reference.kind == kProperty || reference.kind == kContextVariable)
+    payload = AddName(payload);
+  AddEdge(reference.source, reference.target, reference.kind, payload);
+}
+
+
+void ReferenceGraph::AddEdge(uint64_t source, uint64_t target, EdgeKind kind,
+                             uint64_t payload) {
+  if (target == 0) return;
+  if (payload > kUnknownPayload) payload = kUnknownPayload;
+
+  uint32_t id = pending_target_ids_.Find(target);
+  if (id == AddressIndex::kNotFound) {
+    id = pending_targets_.size();
+    pending_target_ids_.Insert(target, id);
+    pending_targets_.push_back(target);
+  }
+  uint32_t label =
+      static_cast<uint32_t>(kind) << 30 | static_cast<uint32_t>(payload);
+  pending_.push_back({source, id, label});
+}
+
+
+uint32_t ReferenceGraph::AddName(uint64_t name) {
+  if (name == 0) return kUnknownPayload;
+
+  uint32_t id = name_ids_.Find(name);
+  if (id != AddressIndex::kNotFound) return id;
+  if (names_.size() >= kUnknownPayload) return kUnknownPayload;
+
+  id = names_.size();
+  name_ids_.Insert(name, id);
+  names_.push_back(name);
+  return id;
+}
+
+
+void ReferenceGraph::Finalize() {
+  // Number the targets in address order, so they can be binary searched.
+  size_t count = pending_targets_.size();
+  std::vector<uint32_t> order(count);
+  for (size_t i = 0; i < count; i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    return pending_targets_[a] < pending_targets_[b];
+  });
+
+  std::vector<uint32_t> node(count);
+  targets_.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    targets_[i] = pending_targets_[order[i]];
+    node[order[i]] = i;
+  }
+  std::vector<uint32_t>().swap(order);
+
+  // Counting sort of the edges by target. It is stable, the edges of a source
+  // stay next to each other.
+  offsets_.assign(count + 1, 0);
+  for (const PendingEdge& edge : pending_) offsets_[node[edge.target] + 1]++;
+  for (size_t i = 0; i < count; i++) offsets_[i + 1] += offsets_[i];
+
+  sources_.resize(pending_.size());
+  labels_.resize(pending_.size());
+  for (const PendingEdge& edge : pending_) {
+    uint64_t pos = offsets_[node[edge.target]]++;
+    sources_[pos] = edge.source;
+    labels_[pos] = edge.label;
+  }
+  // Filling moved every offset to where the next target starts.
+  for (size_t i = count; i > 0; i--) offsets_[i] = offsets_[i - 1];
+  offsets_[0] = 0;
+
+  std::vector<PendingEdge>().swap(pending_);
+  std::vector<uint64_t>().swap(pending_targets_);
+  pending_target_ids_ = AddressIndex();
+  name_ids_ = AddressIndex();
+  loaded_ = true;
+}
+
+
+void ReferenceGraph::Clear() {
+  std::vector<PendingEdge>().swap(pending_);
+  std::vector<uint64_t>().swap(pending_targets_);
+  pending_target_ids_ = AddressIndex();
+  name_ids_ = AddressIndex();
+  std::vector<uint64_t>().swap(targets_);
+  std::vector<uint64_t>().swap(offsets_);
+  std::vector<uint64_t>().swap(sources_);
+  std::vector<uint32_t>().swap(labels_);
+  std::vector<uint64_t>().swap(names_);
+  loaded_ = false;
+}
+
+
+size_t ReferenceGraph::GetMemoryUsage() const {
+  return (targets_.capacity() + offsets_.capacity() + sources_.capacity() +
+          names_.capacity()) *
+             sizeof(uint64_t) +
+         labels_.capacity() * sizeof(uint32_t);
+}
+
+
+void ReferenceGraph::FindEdges(uint64_t target, size_t* begin,
+                               size_t* end) const {
+  auto it = std::lower_bound(targets_.begin(), targets_.end(), target);
+  if (it == targets_.end() || *it != target) {
+    *begin = *end = 0;
+    return;
+  }
+  size_t node = it - targets_.begin();
+  *begin = offsets_[node];
+  *end = offsets_[node + 1];
+}
+
+
+FindJSObjectsVisitor::FindJSObjectsVisitor(SBTarget& target, LLScan* llscan,
+                                           ScanResults* results,
+                                           const HeapScanOptions& options,
+                                           const AddressSet* known_maps)
+    : target_(target),
+      llscan_(llscan),
+      results_(results),
+      known_maps_(known_maps),
+      scan_mode_(options.mode),
+      region_end_(UINT64_MAX),
+      dynamic_layout_(llscan->v8()),
+      map_type_(llscan->v8()->types()->kMapType) {
+  found_count_ = 0;
+  address_byte_size_ = target_.GetProcess().GetAddressByteSize();
+}
+
+
+/* Visit every address, a bit brute force but it works. */
+uint64_t FindJSObjectsVisitor::Visit(uint64_t location, uint64_t word) {
+  return Visit(dynamic_layout_, location, word);
+}
+
+
+template <class Layout>
+uint64_t FindJSObjectsVisitor::Visit(const Layout& layout, uint64_t location,
+                                     uint64_t word) {
+  if (scan_mode_ != HeapScanOptions::kScanPointers) {
+    return VisitObjectStart(layout, location, word);
+  }
+
+  int64_t raw = word;
+  // Skip inspecting things that look like Smi's, they aren't objects.
+  if ((raw & layout.kSmiTagMask) == layout.kSmiTag) return address_byte_size_;
+  if ((raw & layout.kHeapObjectTagMask) != layout.kHeapObjectTag)
+    return address_byte_size_;
+
+  int64_t map_word;
+  if (!LoadMapWord(layout, raw, &map_word)) return address_byte_size_;
+
+  Error err;
+  v8::Map map(llscan_->v8(), map_word);
+  v8::HeapObject heap_object(llscan_->v8(), raw);
+  MapCacheEntry* map_info = GetMapCacheEntry(map, heap_object, err);
+  if (map_info == nullptr) return address_byte_size_;
+
+  RecordObject(word, *map_info);
+
+  /* Just advance one word.
+   * (Should advance by object size, assuming objects can't overlap!)
+   */
+  return address_byte_size_;
+}
+
+
+/* Check if `word` is the map of an object stored at `location`, and if so
+ * skip the whole object. Falls back to the next word when the object can't be
+ * sized.
+ */
+template <class Layout>
+uint64_t FindJSObjectsVisitor::VisitObjectStart(const Layout& layout,
+                                                uint64_t location,
+                                                uint64_t word) {
+  int64_t raw = word;
+  if ((raw & layout.kHeapObjectTagMask) != layout.kHeapObjectTag)
+    return address_byte_size_;
+
+  if (known_maps_ != nullptr) {
+    // Every map was found by the first pass of a two-pass scan.
+    if (!known_maps_->Contains(word)) return address_byte_size_;
+  } else if (map_cache_index_.Find(word) == AddressIndex::kNotFound) {
+    // Only maps we have seen before can skip this check.
+    if (!IsMap(layout, raw)) return address_byte_size_;
+  }
+
+  Error err;
+  v8::Map map(llscan_->v8(), raw);
+  v8::HeapObject heap_object(llscan_->v8(),
+                             location + layout.kHeapObjectTag);
+
+  MapCacheEntry* map_info = GetMapCacheEntry(map, heap_object, err);
+  if (map_info == nullptr) return address_byte_size_;
+
+  // A field which happens to point to a map can claim any size, resync on
+  // the next word rather than skip real objects when it doesn't fit.
+  int64_t size = GetObjectSize(layout, heap_object, *map_info);
+  if (size < address_byte_size_ || size % address_byte_size_ != 0 ||
+      static_cast<uint64_t>(size) > region_end_ - location) {
+    return address_byte_size_;
+  }
+
+  RecordObject(heap_object.raw(), *map_info);
+
+  return size;
+}
+
+
+// Loads the map word of `object`, false if it can't be read or doesn't point
+// to a heap object.
+template <class Layout>
+bool FindJSObjectsVisitor::LoadMapWord(const Layout& layout, int64_t object,
+                                       int64_t* map) {
+  uint64_t value;
+  if (!llscan_->v8()->ReadUnsigned(
+          object - layout.kHeapObjectTag + layout.kMapOffset,
+          layout.kPointerSize, &value)) {
+    return false;
+  }
+  *map = value;
+  return (*map & layout.kHeapObjectTagMask) == layout.kHeapObjectTag;
+}
+
+
+// Whether `object` is a Map, which is when its own map has the Map instance
+// type.
+template <class Layout>
+bool FindJSObjectsVisitor::IsMap(const Layout& layout, int64_t object) {
+  int64_t meta_map;
+  if (!LoadMapWord(layout, object, &meta_map)) return false;
+
+  uint64_t type;
+  if (!llscan_->v8()->ReadUnsigned(
+          meta_map - layout.kHeapObjectTag + layout.kMapInstanceTypeOffset, 2,
+          &type)) {
+    return false;
+  }
+  return static_cast<int64_t>(type & layout.kMapTypeMask) == map_type_;
+}
+
+
+FindJSObjectsVisitor::MapCacheEntry* FindJSObjectsVisitor::GetMapCacheEntry(
+    v8::Map map, v8::HeapObject heap_object, Error& err) {
+  uint32_t index = map_cache_index_.Find(map.raw());
+  if (index != AddressIndex::kNotFound) {
+    results_->stats.map_cache_hits++;
+    return &map_cache_[index];
+  }
+  results_->stats.map_cache_misses++;
+
+  MapCacheEntry map_info;
+  if (!map_info.Load(map, heap_object, llscan_->v8(), err)) return nullptr;
+
+  // Cache result
+  map_cache_index_.Insert(map.raw(), map_cache_.size());
+  map_cache_.push_back(std::move(map_info));
+  return &map_cache_.back();
+}
+
+
+template <class Layout>
+int64_t FindJSObjectsVisitor::GetObjectSize(const Layout& layout,
+                                            v8::HeapObject heap_object,
+                                            MapCacheEntry& map_info) {
+  v8::LLV8* v8 = llscan_->v8();
+  int64_t size;
+
+  switch (map_info.size_kind) {
+    case MapCacheEntry::kFixedSize:
+      return map_info.instance_size;
+    case MapCacheEntry::kSeqOneByteString:
+    case MapCacheEntry::kSeqTwoByteString: {
+      Error err;
+      v8::String str(heap_object);
+      v8::CheckedType<int32_t> length = str.Length(err);
+      if (err.Fail() || !length.Check() || *length < 0) return 0;
+
+      if (map_info.size_kind == MapCacheEntry::kSeqOneByteString) {
+        size = v8->one_byte_string()->kCharsOffset + *length;
+      } else {
+        size = v8->two_byte_string()->kCharsOffset + *length * 2;
+      }
+      break;
+    }
+    case MapCacheEntry::kFixedArray:
+    case MapCacheEntry::kByteArray: {
+      uint64_t value;
+      if (!v8->ReadUnsigned(heap_object.raw() - layout.kHeapObjectTag +
+                                layout.kFixedArrayLengthOffset,
+                            layout.kPointerSize, &value)) {
+        return 0;
+      }
+      int64_t length = value;
+      if ((length & layout.kSmiTagMask) != layout.kSmiTag) return 0;
+      length >>= layout.kSmiShiftSize + layout.kSmiTagMask;
+      if (length < 0) return 0;
+
+      // ByteArray and FixedArray share the FixedArrayBase header.
+      size = layout.kFixedArrayDataOffset;
+      if (map_info.size_kind == MapCacheEntry::kFixedArray) {
+        size += length * layout.kPointerSize;
+      } else {
+        size += length;
+      }
+      break;
+    }
+    default:
+      return 0;
+  }
+
+  // Objects are pointer aligned.
+  int64_t alignment = layout.kPointerSize;
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+
+void FindJSObjectsVisitor::RecordObject(uint64_t word,
+                                        MapCacheEntry& map_info) {
+  Error err;
+
+  if (map_info.is_context) {
+    InsertOnContexts(word, err);
+    return;
+  }
+
+  if (!map_info.is_histogram) return;
+
+  InsertOnMapsToInstances(word, map_info, err);
+  InsertOnDetailedMapsToInstances(word, map_info, err);
+
+  if (err.Fail()) return;
+
+  found_count_++;
+}
+
+void FindJSObjectsVisitor::InsertOnContexts(uint64_t word, Error& err) {
+  results_->contexts.insert(word);
+}
+
+void FindJSObjectsVisitor::InsertOnMapsToInstances(
+    uint64_t word, FindJSObjectsVisitor::MapCacheEntry& map_info, Error& err) {
+  // Resolve the record once per map.
+  if (map_info.type_record == nullptr) {
+    auto pp = &results_->mapstoinstances[map_info.type_name];
+    // No entry in the map, create a new one.
+    if (*pp == nullptr) *pp = new TypeRecord(map_info.type_name);
+    map_info.type_record = *pp;
+  }
+
+  map_info.type_record->AddInstance(word, map_info.instance_size);
+}
+
+void FindJSObjectsVisitor::InsertOnDetailedMapsToInstances(
+    uint64_t word, FindJSObjectsVisitor::MapCacheEntry& map_info, Error& err) {
+  // Resolve the record once per map, maps sharing the same detailed key share
+  // the record.
+  if (map_info.detailed_type_record == nullptr) {
+    auto type_name_with_properties = map_info.GetTypeNameWithProperties();
+
+    auto pp = &results_->detailedmapstoinstances[type_name_with_properties];
+    // No entry in the map, create a new one.
+    if (*pp == nullptr) {
+      auto type_name_with_three_properties = map_info.GetTypeNameWithProperties(
+          MapCacheEntry::kDontShowArrayLength,
+          kNumberOfPropertiesForDetailedOutput);
+      *pp = new DetailedTypeRecord(type_name_with_three_properties,
+                                   map_info.own_descriptors_count_,
+                                   map_info.indexed_properties_count_);
+    }
+    map_info.detailed_type_record = *pp;
+  }
+
+  map_info.detailed_type_record->AddInstance(word, map_info.instance_size);
+}
+
+
+bool FindJSObjectsVisitor::IsAHistogramType(v8::Map& map, Error& err) {
+  int64_t type = map.GetType(err);
+  if (err.Fail()) return false;
+
+  v8::LLV8* v8 = map.v8();
+  if (v8::JSObject::IsObjectType(v8, type)) return true;
+  if (type == v8->types()->kJSArrayType) return true;
+  if (type == v8->types()->kJSTypedArrayType) return true;
+  if (type < v8->types()->kFirstNonstringType) return true;
+  return false;
+}
+
+
+LLScan::LLScan(v8::LLV8* llv8)
+    : llv8_(llv8),
+      scan_mode_(HeapScanOptions::kScanPointers),
+      heap_index_(new HeapIndex()) {}
+
+
+LLScan::~LLScan() {}
+
+
+// The index lives next to the core when we know where the core is, unless the
+// user asked for a specific file. lldb doesn't tell us the path of the core it
+// loaded, so `auto` only works once `core-file` is set.
+std::string LLScan::GetHeapIndexPath() {
+  std::string setting = Settings::GetSettings()->GetHeapIndex();
+  if (setting == "off") return "";
+  if (setting == "auto") {
+    std::string core_file = v8()->GetCoreFile();
+    if (core_file.empty()) {
+      PRINT_DEBUG("Not using heap index: `core-file` isn't set");
+      return "";
+    }
+    return core_file + ".llnode-index";
+  }
+  return setting;
+}
+
+
+// FNV-1a, only used to fingerprint the core.
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+
+HeapIndexKey LLScan::GetHeapIndexKey(const HeapScanOptions& options) {
+  HeapIndexKey key;
+  key.core_path = v8()->GetCoreFile();
+  struct stat st;
+  if (!key.core_path.empty() && stat(key.core_path.c_str(), &st) == 0) {
+    key.core_size = st.st_size;
+    key.core_mtime = st.st_mtime;
+  }
+
+  // Same build-ids as the constants, libnode's too for shared builds.
+  key.build_id = ConstantCache::GetBuildId(target_);
+
+  // The region layout and the first page of a few writable regions tell cores
+  // of the same executable apart, even when we don't know their path.
+  static const uint64_t kSampleSize = 4096;
+  static const int kMaxSamples = 16;
+  unsigned char sample[kSampleSize];
+  int samples = 0;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  lldb::SBMemoryRegionInfoList memory_regions = process_.GetMemoryRegions();
+  lldb::SBMemoryRegionInfo region_info;
+  for (uint32_t i = 0; i < memory_regions.GetSize(); ++i) {
+    memory_regions.GetMemoryRegionAtIndex(i, region_info);
+    uint64_t bounds[2] = {region_info.GetRegionBase(),
+                          region_info.GetRegionEnd()};
+    hash = HashBytes(hash, bounds, sizeof(bounds));
+
+    if (!region_info.IsWritable() || samples == kMaxSamples) continue;
+    SBError sberr;
+    uint64_t size = std::min(kSampleSize, bounds[1] - bounds[0]);
+    if (process_.ReadMemory(bounds[0], sample, size, sberr) == size &&
+        sberr.Success()) {
+      hash = HashBytes(hash, sample, size);
+      samples++;
+    }
+  }
+  key.memory_hash = hash;
+
+  key.scan_mode = options.mode;
+  return key;
+}
+
+
+bool LLScan::LoadHeapIndex(const std::string& path, const HeapIndexKey& key) {
+  Error err;
+  heap_index_->Load(path, key, mapstoinstances_, detailedmapstoinstances_,
+                    contexts_, err);
+  if (err.Fail()) {
+    PRINT_DEBUG("Not using heap index: %s", err.GetMessage());
+    return false;
+  }
+  PRINT_DEBUG("Loaded %zu types from heap index '%s'", mapstoinstances_.size(),
+              path.c_str());
+  return true;
+}
+
+
+void LLScan::SaveHeapIndex(const std::string& path, const HeapIndexKey& key) {
+  Error err;
+  HeapIndex::Write(path, key, mapstoinstances_, detailedmapstoinstances_,
+                   contexts_, err);
+  if (err.Fail()) PRINT_DEBUG("%s", err.GetMessage());
+}
+
+
+bool LLScan::ScanHeapForObjects(lldb::SBTarget target,
+                                lldb::SBCommandReturnObject& result,
+                                const HeapScanOptions& options) {
+  /* Check the last scan is still valid - the process hasn't moved
+   * and we haven't changed target.
+   */
+
+  // Reload process anyway
+  process_ = target.GetProcess();
+
+  // Need to reload memory regions.
+  if (target_ != target) {
+    ClearMapsToInstances();
+    ClearReferences();
+    target_ = target;
+  }
+
+  // Modes don't find the same objects, results of another one are stale once
+  // `scan-mode` changes.
+  if (!mapstoinstances_.empty() && scan_mode_ != options.mode) {
+    ClearMapsToInstances();
+    ClearReferences();
+  }
+
+  /* If we've reached here we have access to information about the valid memory
+   * regions in the process and can scan for objects.
+   */
+
+  /* Populate the map of objects, from the heap index if there's a valid one. */
+  if (mapstoinstances_.empty()) {
+    std::string index_path = GetHeapIndexPath();
+    HeapIndexKey key;
+    if (!index_path.empty()) key = GetHeapIndexKey(options);
+
+    if (index_path.empty() || !LoadHeapIndex(index_path, key)) {
+      ScanMemoryRegions(target, options);
+      if (!index_path.empty()) SaveHeapIndex(index_path, key);
+    }
+    scan_mode_ = options.mode;
+  }
+
+  return true;
+}
+
+std::string FindJSObjectsVisitor::MapCacheEntry::GetTypeNameWithProperties(
+    ShowArrayLength show_array_length, size_t max_properties) {
+  std::string type_name_with_properties(type_name);
+
+  if (show_array_length == kShowArrayLength) {
+    type_name_with_properties +=
+        "[" + std::to_string(indexed_properties_count_) + "]";
   }
 
   size_t i = 0;
@@ -1552,6 +2619,14 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
                                                v8::LLV8* llv8, Error& err) {
   is_histogram = false;
 
+  // Remember how to size objects using this map, object scans use it to skip
+  // over them.
+  int64_t type = map.GetType(err);
+  if (err.Fail()) return false;
+  instance_size = map.InstanceSize(err);
+  if (err.Fail()) return false;
+  size_kind = instance_size > 0 ? kFixedSize : GetVariableSizeKind(type, llv8);
+
   is_context = v8::Context::IsContext(llv8, heap_object, err);
   if (err.Fail()) return false;
   if (is_context) return true;
@@ -1569,7 +2644,6 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
   own_descriptors_count_ = map.NumberOfOwnDescriptors(err);
   if (err.Fail()) return false;
 
-  int64_t type = map.GetType(err);
   indexed_properties_count_ = 0;
   if (v8::JSObject::IsObjectType(llv8, type) ||
       (type == llv8->types()->kJSArrayType)) {
@@ -1588,6 +2662,26 @@ bool FindJSObjectsVisitor::MapCacheEntry::Load(v8::Map map,
 }
 
 
+FindJSObjectsVisitor::MapCacheEntry::SizeKind
+FindJSObjectsVisitor::MapCacheEntry::GetVariableSizeKind(int64_t type,
+                                                         v8::LLV8* llv8) {
+  if (type < llv8->types()->kFirstNonstringType) {
+    // Only sequential strings store their characters inline.
+    int64_t repr = type & llv8->string()->kRepresentationMask;
+    if (repr != llv8->string()->kSeqStringTag) return kUnknownSize;
+
+    int64_t encoding = type & llv8->string()->kEncodingMask;
+    if (encoding == llv8->string()->kOneByteStringTag) return kSeqOneByteString;
+    if (encoding == llv8->string()->kTwoByteStringTag) return kSeqTwoByteString;
+    return kUnknownSize;
+  }
+
+  if (type == llv8->types()->kFixedArrayType) return kFixedArray;
+  if (type == llv8->types()->kByteArrayType) return kByteArray;
+  return kUnknownSize;
+}
+
+
 inline static ByteOrder GetHostByteOrder() {
   union {
     uint8_t a[2];
@@ -1596,102 +2690,846 @@ inline static ByteOrder GetHostByteOrder() {
   return u.b == 1 ? ByteOrder::eByteOrderBig : ByteOrder::eByteOrderLittle;
 }
 
-void LLScan::ScanMemoryRegions(FindJSObjectsVisitor& v) {
-  const uint64_t addr_size = process_.GetAddressByteSize();
-  bool swap_bytes = process_.GetByteOrder() != GetHostByteOrder();
+void PointerPrefilter::Load(lldb::SBProcess process, v8::LLV8* llv8) {
+  addr_size_ = process.GetAddressByteSize();
+  swap_bytes_ = process.GetByteOrder() != GetHostByteOrder();
+  tag_mask_ = llv8->heap_obj()->kTagMask;
+  tag_ = llv8->heap_obj()->kTag;
 
-  // Pages are usually around 1mb, so this should more than enough
-  const uint64_t block_size = 1024 * 1024 * addr_size;
-  unsigned char* block = new unsigned char[block_size];
-
-  lldb::SBMemoryRegionInfoList memory_regions = process_.GetMemoryRegions();
+  ranges_.clear();
+  lldb::SBMemoryRegionInfoList memory_regions = process.GetMemoryRegions();
   lldb::SBMemoryRegionInfo region_info;
 
   for (uint32_t i = 0; i < memory_regions.GetSize(); ++i) {
     memory_regions.GetMemoryRegionAtIndex(i, region_info);
 
-    if (!region_info.IsWritable()) {
+    if (!region_info.IsReadable()) {
       continue;
     }
 
-    uint64_t address = region_info.GetRegionBase();
-    uint64_t len = region_info.GetRegionEnd() - region_info.GetRegionBase();
+    uint64_t start = region_info.GetRegionBase();
+    uint64_t end = region_info.GetRegionEnd();
+    if (!ranges_.empty() && ranges_.back().end == start) {
+      ranges_.back().end = end;
+      ranges_.back().region_end = end;
+    } else {
+      ranges_.push_back({start, end, end});
+    }
+  }
 
-    /* Brute force search - query every address - but allow the visitor code to
-     * say how far to move on so we don't read every byte.
-     */
+  std::sort(ranges_.begin(), ranges_.end(),
+            [](const MemoryRange& a, const MemoryRange& b) {
+              return a.start < b.start;
+            });
 
-    SBError sberr;
-    uint64_t address_end = address + len;
-
-    // Load data in blocks to speed up whole process
-    for (auto searchAddress = address; searchAddress < address_end;
-         searchAddress += block_size) {
-      size_t loaded = std::min(address_end - searchAddress, block_size);
-      process_.ReadMemory(searchAddress, block, loaded, sberr);
-      if (sberr.Fail()) {
-        // TODO(indutny): add error information
-        break;
+  low_ = ranges_.empty() ? 0 : ranges_.front().start;
+  high_ = ranges_.empty() ? 0 : ranges_.back().end;
+}
+
+inline uint64_t PointerPrefilter::LoadWord(const unsigned char* block,
+                                           size_t offset) const {
+  if (addr_size_ == 4) {
+    uint32_t value = *reinterpret_cast<const uint32_t*>(&block[offset]);
+    return swap_bytes_ ? __builtin_bswap32(value) : value;
+  }
+
+  uint64_t value = *reinterpret_cast<const uint64_t*>(&block[offset]);
+  return swap_bytes_ ? __builtin_bswap64(value) : value;
+}
+
+bool PointerPrefilter::IsMapped(uint64_t word) const {
+  if (word < low_ || word >= high_) return false;
+
+  auto it = std::upper_bound(
+      ranges_.begin(), ranges_.end(), word,
+      [](uint64_t w, const MemoryRange& range) { return w < range.start; });
+  if (it == ranges_.begin()) return false;
+  return word < (it - 1)->end;
+}
+
+#if defined(__x86_64__)
+// SSE2 has no 64-bit comparisons, only the tag is checked here and the range
+// check is left to the caller.
+static size_t FilterTaggedSSE2(const uint64_t* words, size_t count,
+                               uint64_t tag_mask, uint64_t tag,
+                               uint32_t* out) {
+  const __m128i mask = _mm_set_epi32(0, tag_mask, 0, tag_mask);
+  const __m128i tags = _mm_set_epi32(0, tag, 0, tag);
+  size_t found = 0;
+  size_t i = 0;
+
+  for (; i + 2 <= count; i += 2) {
+    __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&words[i]));
+    __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(w, mask), tags);
+    int bits = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    if (bits & 0x1) out[found++] = i;
+    if (bits & 0x4) out[found++] = i + 1;
+  }
+  for (; i < count; i++) {
+    if ((words[i] & tag_mask) == tag) out[found++] = i;
+  }
+
+  return found;
+}
+
+__attribute__((target("avx2"))) static size_t FilterTaggedAVX2(
+    const uint64_t* words, size_t count, uint64_t tag_mask, uint64_t tag,
+    uint64_t low, uint64_t high, uint32_t* out) {
+  // Unsigned comparisons are done as signed ones with the sign bit flipped.
+  const uint64_t sign = 1ULL << 63;
+  const __m256i mask = _mm256_set1_epi64x(tag_mask);
+  const __m256i tags = _mm256_set1_epi64x(tag);
+  const __m256i flip = _mm256_set1_epi64x(sign);
+  const __m256i lows = _mm256_set1_epi64x(low ^ sign);
+  const __m256i highs = _mm256_set1_epi64x(high ^ sign);
+  size_t found = 0;
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m256i w =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&words[i]));
+    __m256i tagged = _mm256_cmpeq_epi64(_mm256_and_si256(w, mask), tags);
+    __m256i flipped = _mm256_xor_si256(w, flip);
+    __m256i below = _mm256_cmpgt_epi64(lows, flipped);
+    __m256i above = _mm256_cmpgt_epi64(highs, flipped);
+    __m256i keep = _mm256_andnot_si256(below, _mm256_and_si256(tagged, above));
+    int bits = _mm256_movemask_pd(_mm256_castsi256_pd(keep));
+    while (bits != 0) {
+      int lane = __builtin_ctz(bits);
+      out[found++] = i + lane;
+      bits &= bits - 1;
+    }
+  }
+  for (; i < count; i++) {
+    uint64_t w = words[i];
+    if ((w & tag_mask) == tag && w >= low && w < high) out[found++] = i;
+  }
+
+  return found;
+}
+#endif
+
+void PointerPrefilter::Filter(const unsigned char* block, size_t size,
+                              std::vector<uint32_t>& candidates) const {
+  size_t count = size / addr_size_;
+  candidates.resize(count);
+  size_t found = 0;
+
+#if defined(__x86_64__)
+  if (addr_size_ == 8 && !swap_bytes_) {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(block);
+    if (has_avx2) {
+      found = FilterTaggedAVX2(words, count, tag_mask_, tag_, low_, high_,
+                               candidates.data());
+    } else {
+      found = FilterTaggedSSE2(words, count, tag_mask_, tag_,
+                               candidates.data());
+    }
+  } else
+#endif
+  {
+    for (size_t i = 0; i < count; i++) {
+      if ((LoadWord(block, i * addr_size_) & tag_mask_) == tag_) {
+        candidates[found++] = i;
       }
+    }
+  }
+
+  // Survivors are few enough to check against the actual ranges one by one.
+  size_t kept = 0;
+  for (size_t i = 0; i < found; i++) {
+    uint32_t offset = candidates[i] * addr_size_;
+    if (IsMapped(LoadWord(block, offset))) candidates[kept++] = offset;
+  }
+  candidates.resize(kept);
+}
+
+// Runs `work(worker)` on `jobs` threads, or on the calling one if there's only
+// one job.
+template <typename Work>
+static void RunScanWorkers(size_t jobs, Work work) {
+  if (jobs == 1) {
+    work(0);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < jobs; i++) workers.emplace_back(work, i);
+  for (auto& worker : workers) worker.join();
+}
+
+ScanReader::ScanReader(LLScan* llscan, const std::vector<MemoryRange>& chunks,
+                       uint64_t block_size, size_t workers, size_t read_ahead)
+    : llscan_(llscan),
+      chunks_(chunks),
+      block_size_(block_size),
+      blocks_(workers + read_ahead),
+      pipelined_(read_ahead > 0),
+      stop_(false),
+      read_seconds_(0) {
+  for (Block& block : blocks_) {
+    block.data = nullptr;
+    block.state = Block::kFree;
+    block.buffer = new unsigned char[block_size];
+  }
+  if (pipelined_) reader_ = std::thread(&ScanReader::Run, this);
+}
 
-      uint32_t increment = 1;
-      for (size_t j = 0; j + addr_size <= loaded;) {
-        uint64_t value;
 
-        if (addr_size == 4) {
-          value = *reinterpret_cast<uint32_t*>(&block[j]);
-          if (swap_bytes) {
-            value = __builtin_bswap32(value);
+ScanReader::~ScanReader() {
+  if (pipelined_) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    released_.notify_all();
+    reader_.join();
+  }
+  for (Block& block : blocks_) delete[] block.buffer;
+}
+
+
+double ScanReader::Load(Block& block, size_t chunk, size_t index) {
+  auto start = std::chrono::steady_clock::now();
+
+  const MemoryRange& range = chunks_[chunk];
+  block.chunk = chunk;
+  block.index = index;
+  block.address = range.start + index * block_size_;
+  block.size = std::min(range.end - block.address, block_size_);
+  block.data = llscan_->LoadBlock(block.address, block.size, block.buffer);
+
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  return time.count();
+}
+
+
+// Reader thread: loads every block in order into whichever ring slot is free.
+void ScanReader::Run() {
+  for (size_t chunk = 0; chunk < chunks_.size(); chunk++) {
+    for (size_t index = 0; index < GetBlockCount(chunk); index++) {
+      Block* block = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        released_.wait(lock, [&] {
+          for (Block& candidate : blocks_) {
+            if (candidate.state == Block::kFree) {
+              block = &candidate;
+              return true;
+            }
           }
-        } else if (addr_size == 8) {
-          value = *reinterpret_cast<uint64_t*>(&block[j]);
-          if (swap_bytes) {
-            value = __builtin_bswap64(value);
+          return stop_;
+        });
+        if (stop_) return;
+        block->state = Block::kLoading;
+      }
+
+      double seconds = Load(*block, chunk, index);
+      bool failed = block->data == nullptr;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        block->state = Block::kLoaded;
+        read_seconds_ += seconds;
+      }
+      loaded_.notify_all();
+
+      // Workers stop at the first block of a chunk which can't be read.
+      if (failed) break;
+    }
+  }
+}
+
+
+const ScanReader::Block* ScanReader::Acquire(size_t worker, size_t chunk,
+                                             size_t index, ScanStats& stats) {
+  if (!pipelined_) {
+    Block& block = blocks_[worker];
+    stats.read_seconds += Load(block, chunk, index);
+    return &block;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  Block* block = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    loaded_.wait(lock, [&] {
+      for (Block& candidate : blocks_) {
+        if (candidate.state == Block::kLoaded && candidate.chunk == chunk &&
+            candidate.index == index) {
+          block = &candidate;
+          return true;
+        }
+      }
+      return false;
+    });
+    block->state = Block::kInUse;
+  }
+
+  std::chrono::duration<double> wait = std::chrono::steady_clock::now() - start;
+  stats.wait_seconds += wait.count();
+  return block;
+}
+
+
+void ScanReader::Release(const Block* block) {
+  if (!pipelined_) return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const_cast<Block*>(block)->state = Block::kFree;
+  }
+  released_.notify_one();
+}
+
+
+void ScanReader::Skip(size_t worker, size_t chunk, size_t index,
+                      ScanStats& stats) {
+  // Nothing was loaded ahead without a reader thread.
+  if (!pipelined_) return;
+
+  for (; index < GetBlockCount(chunk); index++) {
+    const Block* block = Acquire(worker, chunk, index, stats);
+    bool failed = block->data == nullptr;
+    Release(block);
+    if (failed) break;
+  }
+}
+
+
+void LLScan::ScanMemoryRegions(SBTarget& target,
+                               const HeapScanOptions& options) {
+  const uint64_t addr_size = process_.GetAddressByteSize();
+
+  // Pages are usually around 1mb, so this should more than enough
+  const uint64_t block_size = 1024 * 1024 * addr_size;
+
+  // Regions are split in chunks of a few blocks so that workers can share a
+  // large heap region. Chunks are handed out in address order and each worker
+  // keeps its own results, which are merged in worker order at the end.
+  std::vector<MemoryRange> chunks =
+      GetScanChunks(kBlocksPerChunk * block_size);
+
+  size_t jobs = options.jobs > 0 ? options.jobs
+                                 : std::thread::hardware_concurrency();
+  jobs = std::max<size_t>(1, std::min(jobs, chunks.size()));
+
+  // V8 constants are loaded lazily on first use, make sure workers won't race
+  // to load them.
+  if (jobs > 1) v8()->LoadAllConstants();
+
+  PointerPrefilter prefilter;
+  prefilter.Load(process_, v8());
+
+  // The object scan is instantiated once per layout, pick the one matching
+  // this target.
+  v8::layouts::Dynamic dynamic_layout(v8());
+  v8::layouts::LayoutId layout = options.static_layout
+                                     ? v8::layouts::Select(dynamic_layout)
+                                     : v8::layouts::kDynamic;
+  PRINT_DEBUG("Scanning with the %s object layout",
+              layout == v8::layouts::kDynamic ? "dynamic" : "compile-time");
+
+  auto scan_start = std::chrono::steady_clock::now();
+  size_t read_ahead = std::max(0, options.read_ahead);
+  double read_seconds = 0;
+
+  // First pass of two-pass scans: collect the address of every Map, which are
+  // the objects using a meta map as their map.
+  AddressSet known_maps;
+  std::vector<ScanStats> map_stats(jobs);
+  if (options.mode == HeapScanOptions::kScanTwoPass) {
+    unsigned char* block = new unsigned char[block_size];
+    uint64_t meta_map = FindMetaMap(chunks, prefilter, block, block_size);
+    delete[] block;
+
+    std::vector<uint64_t> meta_maps;
+    if (meta_map != 0) meta_maps.push_back(meta_map);
+
+    // A meta map found by a worker, e.g. the one of a second native context,
+    // only helps that worker with the words after it. Every meta map is found
+    // by the first sweep though, so when it finds new ones the maps are
+    // collected again knowing all of them.
+    for (int sweep = 0; sweep < 2; sweep++) {
+      std::vector<std::vector<uint64_t>> maps(jobs);
+      std::vector<std::vector<uint64_t>> worker_meta_maps(jobs, meta_maps);
+      std::atomic<size_t> next_chunk(0);
+      ScanReader reader(this, chunks, block_size, jobs, read_ahead);
+      RunScanWorkers(jobs, [&](size_t worker) {
+        for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++) {
+          FindMapsInRange(i, reader, worker, prefilter, map_stats[worker],
+                          worker_meta_maps[worker], maps[worker]);
+        }
+      });
+      read_seconds += reader.GetReadSeconds();
+
+      size_t known_meta_maps = meta_maps.size();
+      for (auto& found : worker_meta_maps) {
+        for (uint64_t map : found) {
+          if (std::find(meta_maps.begin(), meta_maps.end(), map) ==
+              meta_maps.end()) {
+            meta_maps.push_back(map);
           }
-        } else {
-          break;
         }
+      }
+      if (sweep == 0 && meta_maps.size() != known_meta_maps) {
+        PRINT_DEBUG("Found %zu meta maps, collecting maps again",
+                    meta_maps.size());
+        continue;
+      }
 
-        increment = v.Visit(j + searchAddress, value);
-        if (increment == 0) break;
+      for (auto& worker_maps : maps) {
+        for (uint64_t map : worker_maps) known_maps.Insert(map);
+      }
+      break;
+    }
+  }
 
-        j += static_cast<size_t>(increment);
+  std::vector<ScanResults> results(jobs);
+  std::atomic<size_t> next_chunk(0);
+  {
+    ScanReader reader(this, chunks, block_size, jobs, read_ahead);
+    RunScanWorkers(jobs, [&](size_t worker) {
+      FindJSObjectsVisitor v(target, this, &results[worker], options,
+                             options.mode == HeapScanOptions::kScanTwoPass
+                                 ? &known_maps
+                                 : nullptr);
+
+      for (size_t i = next_chunk++; i < chunks.size(); i = next_chunk++) {
+        switch (layout) {
+          case v8::layouts::kFull64:
+            ScanMemoryRange(v8::layouts::Full64(), v, i, reader, worker,
+                            prefilter, results[worker].stats);
+            break;
+          case v8::layouts::kDynamic:
+            ScanMemoryRange(dynamic_layout, v, i, reader, worker, prefilter,
+                            results[worker].stats);
+            break;
+        }
       }
+    });
+    read_seconds += reader.GetReadSeconds();
+  }
+  std::chrono::duration<double> scan_time =
+      std::chrono::steady_clock::now() - scan_start;
+
+  scan_stats_ = ScanStats();
+  for (auto& stats : map_stats) scan_stats_.Merge(stats);
+  for (auto& worker_results : results) MergeScanResults(worker_results);
+  scan_stats_.read_seconds += read_seconds;
+  FinalizeScanResults(options, jobs);
+
+  // Without read-ahead, workers read their own blocks: reading and visiting
+  // only overlap across workers.
+  PRINT_DEBUG("Scan: %.3fs with %zu workers and read-ahead %zu. Reading "
+              "%.3fs, visiting %.3fs, waiting for reads %.3fs",
+              scan_time.count(), jobs, read_ahead, scan_stats_.read_seconds,
+              scan_stats_.visit_seconds, scan_stats_.wait_seconds);
+
+  uint64_t lookups =
+      scan_stats_.map_cache_hits + scan_stats_.map_cache_misses;
+  PRINT_DEBUG("Map cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%%)",
+              scan_stats_.map_cache_hits, scan_stats_.map_cache_misses,
+              lookups ? 100.0 * scan_stats_.map_cache_hits / lookups : 0.0);
+  v8::MemoryCache::Stats memory_stats = v8()->GetMemoryCacheStats();
+  PRINT_DEBUG("Memory cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+              " uncached reads",
+              memory_stats.hits, memory_stats.misses, memory_stats.uncached);
+}
 
-      if (increment == 0) {
-        break;
+// Finds a meta map (the map of Maps) by following the map pointers of the
+// first objects found, returns 0 if there's none.
+uint64_t LLScan::FindMetaMap(const std::vector<MemoryRange>& chunks,
+                             const PointerPrefilter& prefilter,
+                             unsigned char* block, uint64_t block_size) {
+  // Objects are everywhere, a handful of candidates is usually enough.
+  const size_t kMaxAttempts = 1024;
+  size_t attempts = 0;
+  std::vector<uint32_t> candidates;
+
+  for (const MemoryRange& range : chunks) {
+    size_t loaded = std::min(range.end - range.start, block_size);
+    const unsigned char* data = LoadBlock(range.start, loaded, block);
+    if (data == nullptr) continue;
+
+    prefilter.Filter(data, loaded, candidates);
+    for (uint32_t offset : candidates) {
+      if (attempts++ == kMaxAttempts) return 0;
+
+      Error err;
+      v8::HeapObject object(v8(), prefilter.LoadWord(data, offset));
+      v8::HeapObject map = object.GetMap(err);
+      if (err.Fail() || !map.Check()) continue;
+      v8::HeapObject meta_map = map.GetMap(err);
+      if (err.Fail() || !meta_map.Check()) continue;
+
+      // The meta map is its own map.
+      v8::HeapObject meta_map_map = meta_map.GetMap(err);
+      if (err.Fail() || meta_map_map.raw() != meta_map.raw()) continue;
+      if (v8::Map(meta_map).GetType(err) != v8()->types()->kMapType) continue;
+
+      return meta_map.raw();
+    }
+  }
+
+  return 0;
+}
+
+// Appends to `maps` the address of every object in `range` using one of
+// `meta_maps` as its map. Meta maps found on the way, which are their own map,
+// are added to `meta_maps`.
+void LLScan::FindMapsInRange(size_t chunk, ScanReader& reader, size_t worker,
+                             const PointerPrefilter& prefilter,
+                             ScanStats& stats,
+                             std::vector<uint64_t>& meta_maps,
+                             std::vector<uint64_t>& maps) {
+  std::vector<uint32_t> candidates;
+
+  for (size_t index = 0; index < reader.GetBlockCount(chunk); index++) {
+    const ScanReader::Block* block =
+        reader.Acquire(worker, chunk, index, stats);
+    if (block->data == nullptr) {
+      reader.Release(block);
+      break;
+    }
+    auto visit_start = std::chrono::steady_clock::now();
+
+    prefilter.Filter(block->data, block->size, candidates);
+    for (uint32_t offset : candidates) {
+      uint64_t word = prefilter.LoadWord(block->data, offset);
+      uint64_t object =
+          v8::HeapObject::FromAddress(v8(), block->address + offset).raw();
+
+      if (word == object) {
+        Error err;
+        if (v8::Map(v8(), word).GetType(err) != v8()->types()->kMapType ||
+            err.Fail()) {
+          continue;
+        }
+        if (std::find(meta_maps.begin(), meta_maps.end(), word) ==
+            meta_maps.end()) {
+          meta_maps.push_back(word);
+        }
+        maps.push_back(object);
+        continue;
+      }
+
+      if (std::find(meta_maps.begin(), meta_maps.end(), word) !=
+          meta_maps.end()) {
+        maps.push_back(object);
       }
     }
+
+    std::chrono::duration<double> visit_time =
+        std::chrono::steady_clock::now() - visit_start;
+    stats.visit_seconds += visit_time.count();
+    reader.Release(block);
+  }
+}
+
+std::vector<MemoryRange> LLScan::GetScanChunks(uint64_t chunk_size) {
+  std::vector<MemoryRange> chunks;
+
+  lldb::SBMemoryRegionInfoList memory_regions = process_.GetMemoryRegions();
+  lldb::SBMemoryRegionInfo region_info;
+
+  for (uint32_t i = 0; i < memory_regions.GetSize(); ++i) {
+    memory_regions.GetMemoryRegionAtIndex(i, region_info);
+
+    if (!region_info.IsWritable()) {
+      continue;
+    }
+
+    uint64_t address_end = region_info.GetRegionEnd();
+    for (uint64_t address = region_info.GetRegionBase(); address < address_end;
+         address += chunk_size) {
+      chunks.push_back(
+          {address, std::min(address + chunk_size, address_end), address_end});
+    }
   }
 
-  delete[] block;
+  return chunks;
 }
 
-void LLScan::ClearMapsToInstances() {
-  TypeRecord* t;
-  for (auto entry : mapstoinstances_) {
-    t = entry.second;
-    delete t;
+// Returns the `size` bytes of memory at `address`. They're read in place from
+// the mapped core when possible, and loaded into `block` otherwise.
+const unsigned char* LLScan::LoadBlock(uint64_t address, uint64_t size,
+                                       unsigned char* block) {
+  const unsigned char* mapped = v8()->core_file_.GetPointer(address, size);
+  if (mapped != nullptr) return mapped;
+
+  SBError sberr;
+  process_.ReadMemory(address, block, size, sberr);
+  return sberr.Fail() ? nullptr : block;
+}
+
+template <class Layout>
+void LLScan::ScanMemoryRange(const Layout& layout, FindJSObjectsVisitor& v,
+                             size_t chunk, ScanReader& reader, size_t worker,
+                             const PointerPrefilter& prefilter,
+                             ScanStats& stats) {
+  /* Brute force search - query every address - but allow the visitor code to
+   * say how far to move on so we don't read every byte. Words which can't be
+   * pointers to an object never reach the visitor.
+   */
+
+  std::vector<uint32_t> candidates;
+  // Objects skipped as a whole may end past the block they start in.
+  uint64_t searchAddress = reader.GetChunk(chunk).start;
+  v.SetRegionEnd(reader.GetChunk(chunk).region_end);
+
+  for (size_t index = 0; index < reader.GetBlockCount(chunk); index++) {
+    const ScanReader::Block* block =
+        reader.Acquire(worker, chunk, index, stats);
+    if (block->data == nullptr) {
+      // TODO(indutny): add error information
+      reader.Release(block);
+      break;
+    }
+
+    uint64_t block_end = block->address + block->size;
+    if (searchAddress >= block_end) {
+      reader.Release(block);
+      continue;
+    }
+    auto visit_start = std::chrono::steady_clock::now();
+
+    prefilter.Filter(block->data, block->size, candidates);
+
+    uint64_t increment = 1;
+    size_t j = searchAddress - block->address;
+    for (uint32_t offset : candidates) {
+      // Skipped by the visitor as part of a bigger object.
+      if (offset < j) continue;
+
+      uint64_t value = prefilter.LoadWord(block->data, offset);
+      increment = v.Visit(layout, offset + block->address, value);
+      if (increment == 0) break;
+
+      j = offset + static_cast<size_t>(increment);
+    }
+    searchAddress = block->address + std::max<uint64_t>(j, block->size);
+
+    std::chrono::duration<double> visit_time =
+        std::chrono::steady_clock::now() - visit_start;
+    stats.visit_seconds += visit_time.count();
+    reader.Release(block);
+
+    if (increment == 0) {
+      reader.Skip(worker, chunk, index + 1, stats);
+      break;
+    }
+  }
+}
+
+void LLScan::MergeScanResults(ScanResults& results) {
+  TypeRecordMap& types = results.mapstoinstances;
+  for (uint32_t id = 0; id < types.size(); id++) {
+    TypeRecord*& t = mapstoinstances_[types.GetName(id)];
+    if (t == nullptr) {
+      t = types.Get(id);
+    } else {
+      t->Merge(types.Get(id));
+      delete types.Get(id);
+    }
   }
+  results.mapstoinstances.clear();
+
+  DetailedTypeRecordMap& detailed = results.detailedmapstoinstances;
+  for (uint32_t id = 0; id < detailed.size(); id++) {
+    DetailedTypeRecord*& t = detailedmapstoinstances_[detailed.GetName(id)];
+    if (t == nullptr) {
+      t = detailed.Get(id);
+    } else {
+      t->Merge(detailed.Get(id));
+      delete detailed.Get(id);
+    }
+  }
+  results.detailedmapstoinstances.clear();
+
+  contexts_.insert(results.contexts.begin(), results.contexts.end());
+  results.contexts.clear();
+
+  scan_stats_.Merge(results.stats);
+}
+
+// Records are sorted and deduplicated in parallel, they don't share anything.
+void LLScan::FinalizeScanResults(const HeapScanOptions& options, size_t jobs) {
+  std::vector<TypeRecord*> records(mapstoinstances_.begin(),
+                                   mapstoinstances_.end());
+  records.insert(records.end(), detailedmapstoinstances_.begin(),
+                 detailedmapstoinstances_.end());
+
+  std::atomic<size_t> next_record(0);
+  RunScanWorkers(std::max<size_t>(1, std::min(jobs, records.size())),
+                 [&](size_t worker) {
+                   for (size_t i = next_record++; i < records.size();
+                        i = next_record++) {
+                     records[i]->Finalize(options.compress_instances);
+                   }
+                 });
+}
+
+void LLScan::AddObjectReferences(
+    v8::JSObject& js_obj, std::vector<ReferenceGraph::Reference>& bucket) {
+  Error err;
+  int64_t length = js_obj.GetArrayLength(err);
+  for (int64_t i = 0; i < length; ++i) {
+    v8::Value v = js_obj.GetArrayElement(i, err);
+
+    // Array is borked, or not array at all - skip it
+    if (!err.Success()) break;
+    if (v8::Smi(v).Check()) continue;
+    bucket.push_back({static_cast<uint64_t>(js_obj.raw()),
+                      static_cast<uint64_t>(v.raw()),
+                      static_cast<uint64_t>(i), ReferenceGraph::kElement});
+  }
+
+  std::vector<std::pair<v8::Value, v8::Value>> entries = js_obj.Entries(err);
+  if (err.Fail()) return;
+  for (auto& entry : entries) {
+    v8::Value v = entry.second;
+    if (v8::Smi(v).Check()) continue;
+    bucket.push_back({static_cast<uint64_t>(js_obj.raw()),
+                      static_cast<uint64_t>(v.raw()),
+                      static_cast<uint64_t>(entry.first.raw()),
+                      ReferenceGraph::kProperty});
+  }
+}
+
+
+void LLScan::AddStringReferences(
+    v8::String& str, std::vector<ReferenceGraph::Reference>& bucket) {
+  Error err;
+  v8::LLV8* v8 = str.v8();
+  uint64_t source = str.raw();
+
+  v8::CheckedType<int64_t> repr = str.Representation(err);
+  RETURN_IF_INVALID(repr, );
+
+  // Concatenated, sliced and thin strings refer to other strings.
+  if (*repr == v8->string()->kSlicedStringTag) {
+    v8::SlicedString sliced_str(str);
+    v8::String parent = sliced_str.Parent(err);
+    if (err.Success()) {
+      bucket.push_back({source, static_cast<uint64_t>(parent.raw()),
+                        ReferenceGraph::kParent, ReferenceGraph::kInternal});
+    }
+  } else if (*repr == v8->string()->kConsStringTag) {
+    v8::ConsString cons_str(str);
+    v8::String first = cons_str.First(err);
+    if (err.Success()) {
+      bucket.push_back({source, static_cast<uint64_t>(first.raw()),
+                        ReferenceGraph::kFirst, ReferenceGraph::kInternal});
+    }
+    v8::String second = cons_str.Second(err);
+    if (err.Success()) {
+      bucket.push_back({source, static_cast<uint64_t>(second.raw()),
+                        ReferenceGraph::kSecond, ReferenceGraph::kInternal});
+    }
+  } else if (*repr == v8->string()->kThinStringTag) {
+    v8::ThinString thin_str(str);
+    v8::String actual = thin_str.Actual(err);
+    if (err.Success()) {
+      bucket.push_back({source, static_cast<uint64_t>(actual.raw()),
+                        ReferenceGraph::kActual, ReferenceGraph::kInternal});
+    }
+  }
+}
+
+
+void LLScan::AddContextReferences(
+    uint64_t context, std::vector<ReferenceGraph::Reference>& bucket) {
+  Error err;
+  v8::HeapObject context_obj(llv8_, context);
+  v8::Context c(context_obj);
+
+  v8::Context::Locals locals(&c, err);
+  if (err.Fail()) return;
+
+  for (v8::Context::Locals::Iterator it = locals.begin(); it != locals.end();
+       it++) {
+    v8::Value v = *it;
+    if (v8::Smi(v).Check()) continue;
+
+    // Unknown names are left as 0.
+    uint64_t name = 0;
+    v8::String local_name = it.LocalName(err);
+    if (err.Success()) name = local_name.raw();
+    bucket.push_back({context, static_cast<uint64_t>(v.raw()), name,
+                      ReferenceGraph::kContextVariable});
+  }
+}
+
+
+void LLScan::BuildReferenceGraph() {
+  typedef std::vector<ReferenceGraph::Reference> Bucket;
+  auto start = std::chrono::steady_clock::now();
+  reference_graph_.Clear();
+
+  VisitInstances<Bucket>(
+      Settings::GetSettings()->GetScanThreads(),
+      [this](uint64_t addr, Bucket& bucket) {
+        Error err;
+        v8::HeapObject heap_object(llv8_, addr);
+        int64_t type = heap_object.GetType(err);
+        if (err.Fail()) return;
+
+        // Only the types in FindJSObjectsVisitor::IsAHistogramType end up in
+        // the instance lists. Objects can have elements and arrays can have
+        // named properties, both are walked for either.
+        if (v8::JSObject::IsObjectType(llv8_, type) ||
+            type == llv8_->types()->kJSArrayType) {
+          v8::JSObject js_obj(heap_object);
+          AddObjectReferences(js_obj, bucket);
+        } else if (type < llv8_->types()->kFirstNonstringType) {
+          v8::String str(heap_object);
+          AddStringReferences(str, bucket);
+        }
+      },
+      [this](Bucket& bucket) {
+        for (const ReferenceGraph::Reference& reference : bucket)
+          reference_graph_.AddReference(reference);
+      });
+
+  Bucket bucket;
+  for (uint64_t context : contexts_) AddContextReferences(context, bucket);
+  for (const ReferenceGraph::Reference& reference : bucket)
+    reference_graph_.AddReference(reference);
+
+  reference_graph_.Finalize();
+
+  std::chrono::duration<double> build_time =
+      std::chrono::steady_clock::now() - start;
+  PRINT_DEBUG("Reference graph: %zu values, %zu edges, %zu kB, built in %.3fs",
+              reference_graph_.GetNodeCount(),
+              reference_graph_.GetEdgeCount(),
+              reference_graph_.GetMemoryUsage() / 1024, build_time.count());
+}
+
+
+void LLScan::ClearMapsToInstances() {
+  for (TypeRecord* t : mapstoinstances_) delete t;
   mapstoinstances_.clear();
+  for (DetailedTypeRecord* t : detailedmapstoinstances_) delete t;
+  detailedmapstoinstances_.clear();
+  contexts_.clear();
+  // Records loaded from an index point into it.
+  heap_index_->Close();
 }
 
 void LLScan::ClearReferences() {
   ReferencesVector* references;
 
-  for (auto entry : references_by_value_) {
-    references = entry.second;
-    delete references;
-  }
-  references_by_value_.clear();
+  reference_graph_.Clear();
 
-  for (auto entry : references_by_property_) {
+  for (const auto& entry : references_by_property_) {
     references = entry.second;
     delete references;
   }
   references_by_property_.clear();
 
-  for (auto entry : references_by_string_) {
+  for (const auto& entry : references_by_string_) {
     references = entry.second;
     delete references;
   }
@@ -2,24 +2,36 @@
 #define SRC_LLSCAN_H_
 
 #include <lldb/API/LLDB.h>
+#include <algorithm>
+#include <condition_variable>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "src/error.h"
 #include "src/llnode.h"
+#include "src/llv8-layouts.h"
 #include "src/printer.h"
 
 namespace llnode {
 
+class AddressSet;
+class HeapIndex;
+struct HeapIndexKey;
 class LLScan;
+class ReferenceGraph;
 
 typedef std::vector<uint64_t> ReferencesVector;
 typedef std::unordered_set<uint64_t> ContextVector;
 
-typedef std::map<uint64_t, ReferencesVector*> ReferencesByValueMap;
 typedef std::map<std::string, ReferencesVector*> ReferencesByPropertyMap;
-typedef std::map<std::string, ReferencesVector*> ReferencesByStringMap;
+// Keyed by v8::StringView::Hash() of the string contents.
+typedef std::unordered_map<uint64_t, ReferencesVector*> ReferencesByStringMap;
 
 
 // New type defining pagination options
@@ -32,7 +44,40 @@ struct cmd_pagination_t {
   std::string command = "";
 };
 
-char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options);
+// Options which control how LLScan walks the process memory looking for
+// objects. Defaults come from `v8 settings`, commands may override them for a
+// single scan.
+class HeapScanOptions {
+ public:
+  enum ScanMode {
+    // Every word is treated as a possible pointer to an object.
+    kScanPointers,
+    // Every word is checked for being the map word of an object stored right
+    // there. Objects found this way are skipped as a whole.
+    kScanObjects,
+    // Like kScanObjects, but a first pass collects the address of every Map
+    // so that map words can be checked without reading memory.
+    kScanTwoPass,
+  };
+
+  HeapScanOptions();
+
+  // Number of worker threads, 0 means one per available core.
+  int jobs;
+  ScanMode mode;
+  // Store instance addresses as varint encoded deltas.
+  bool compress_instances;
+  // Blocks loaded ahead of the workers by a reader thread, 0 makes workers
+  // load their own blocks.
+  int read_ahead;
+  // Scan with the compile-time layout of the target's V8 line when it matches
+  // the target's constants.
+  bool static_layout;
+};
+
+// Returns nullptr when `scan_options` are given and --jobs isn't a number.
+char** ParsePrinterOptions(char** cmd, Printer::PrinterOptions* options,
+                           HeapScanOptions* scan_options = nullptr);
 
 class FindObjectsCmd : public CommandBase {
  public:
@@ -81,10 +126,22 @@ class ScanOptions {
   // Defines what are we looking for
   enum ScanType { kFieldValue, kPropertyName, kStringValue, kBadOption };
 
-  ScanOptions() : scan_type(ScanType::kFieldValue), recursive_scan(false) {}
+  ScanOptions()
+      : scan_type(ScanType::kFieldValue),
+        recursive_scan(false),
+        breadth_first(false),
+        max_depth(0),
+        max_children(0) {}
 
   ScanType scan_type;
   bool recursive_scan;
+  // Recursive scans visit the nearest referrers first.
+  bool breadth_first;
+  // Limits for recursive scans, 0 means no limit. The depth counts levels
+  // below the direct references, the children limit applies to every object
+  // below them.
+  int max_depth;
+  int max_children;
 };
 
 class FindReferencesCmd : public CommandBase {
@@ -97,16 +154,34 @@ class FindReferencesCmd : public CommandBase {
 
   char** ParseScanOptions(char** cmd, ScanOptions* options);
 
+  // What a worker of ScanForReferences() found in a batch of instances: the
+  // key, a property name or a string hash depending on the scanner, and the
+  // object referring to it.
+  struct ReferenceBucket {
+    std::vector<std::pair<std::string, uint64_t>> properties;
+    std::vector<std::pair<uint64_t, uint64_t>> strings;
+  };
+
   class ObjectScanner {
    public:
     virtual ~ObjectScanner() {}
 
     virtual bool AreReferencesLoaded() { return false; };
+    // Fills whatever GetReferences() answers from, by default by calling
+    // ScanRefs() for every instance.
+    virtual void LoadReferences(FindReferencesCmd* cli_cmd) {
+      cli_cmd->ScanForReferences(this);
+    }
 
     virtual ReferencesVector* GetReferences() { return nullptr; };
 
-    virtual void ScanRefs(v8::JSObject& js_obj, Error& err){};
-    virtual void ScanRefs(v8::String& str, Error& err){};
+    // Called on the worker threads of ScanForReferences(), which must only
+    // touch `bucket`. MergeRefs() then gets the buckets in instance order.
+    virtual void ScanRefs(v8::JSObject& js_obj, ReferenceBucket& bucket,
+                          Error& err){};
+    virtual void ScanRefs(v8::String& str, ReferenceBucket& bucket,
+                          Error& err){};
+    virtual void MergeRefs(ReferenceBucket& bucket){};
 
     virtual void PrintRefs(lldb::SBCommandReturnObject& result,
                            v8::JSObject& js_obj, Error& err, int level = 0) {}
@@ -117,38 +192,45 @@ class FindReferencesCmd : public CommandBase {
     virtual void PrintContextRefs(lldb::SBCommandReturnObject& result,
                                   Error& err, FindReferencesCmd* cli_cmd_,
                                   ScanOptions* options,
-                                  ReferencesVector* already_visited_references,
+                                  AddressSet* already_visited_references,
                                   int level = 0) {}
 
-    std::string GetPropertyReferenceString(int level = 0);
-    std::string GetArrayReferenceString(int level = 0);
+    static std::string GetPropertyReferenceString(int level = 0);
+    static std::string GetArrayReferenceString(int level = 0);
   };
 
   void PrintReferences(lldb::SBCommandReturnObject& result,
                        ReferencesVector* references, ObjectScanner* scanner,
                        ScanOptions* options,
-                       ReferencesVector* already_visited_references,
+                       AddressSet* already_visited_references,
                        int level = 0);
 
   void ScanForReferences(ObjectScanner* scanner);
 
   void PrintRecursiveReferences(lldb::SBCommandReturnObject& result,
                                 ScanOptions* options,
-                                ReferencesVector* visited_references,
+                                AddressSet* visited_references,
                                 uint64_t address, int level);
 
+  // Prints the referrers of each of `references`, then theirs, level by
+  // level.
+  void PrintBreadthFirstReferences(lldb::SBCommandReturnObject& result,
+                                   ScanOptions* options,
+                                   AddressSet* visited_references,
+                                   const ReferencesVector& references,
+                                   int level);
+
+  // Answers from the reference graph of LLScan.
   class ReferenceScanner : public ObjectScanner {
    public:
     ReferenceScanner(LLScan* llscan, v8::Value search_value)
         : llscan_(llscan), search_value_(search_value) {}
 
     bool AreReferencesLoaded() override;
+    void LoadReferences(FindReferencesCmd* cli_cmd) override;
 
     ReferencesVector* GetReferences() override;
 
-    void ScanRefs(v8::JSObject& js_obj, Error& err) override;
-    void ScanRefs(v8::String& str, Error& err) override;
-
     void PrintRefs(lldb::SBCommandReturnObject& result, v8::JSObject& js_obj,
                    Error& err, int level = 0) override;
     void PrintRefs(lldb::SBCommandReturnObject& result, v8::String& str,
@@ -156,12 +238,27 @@ class FindReferencesCmd : public CommandBase {
 
     void PrintContextRefs(lldb::SBCommandReturnObject& result, Error& err,
                           FindReferencesCmd* cli_cmd_, ScanOptions* options,
-                          ReferencesVector* already_visited_references,
+                          AddressSet* already_visited_references,
                           int level = 0) override;
 
+    // Prints the edges [`begin`, `end`) of `graph`, which all go from one
+    // source to `target`. Every line starts with `indent`.
+    static void PrintEdges(lldb::SBCommandReturnObject& result,
+                           LLScan* llscan, const ReferenceGraph& graph,
+                           uint64_t target, size_t begin, size_t end,
+                           const std::string& indent);
+
    private:
+    // Sets [`begin`, `end`) to the edges from `source` to search_value_.
+    void FindEdges(uint64_t source, size_t* begin, size_t* end);
+
     LLScan* llscan_;
     v8::Value search_value_;
+    // Objects and strings referring to search_value_, contexts are left to
+    // PrintContextRefs().
+    ReferencesVector references_;
+    // Where the edges of each of references_ start and end.
+    std::unordered_map<uint64_t, std::pair<size_t, size_t>> edges_;
   };
 
   class PropertyScanner : public ObjectScanner {
@@ -173,7 +270,9 @@ class FindReferencesCmd : public CommandBase {
 
     ReferencesVector* GetReferences() override;
 
-    void ScanRefs(v8::JSObject& js_obj, Error& err) override;
+    void ScanRefs(v8::JSObject& js_obj, ReferenceBucket& bucket,
+                  Error& err) override;
+    void MergeRefs(ReferenceBucket& bucket) override;
 
     // We only scan properties on objects not Strings, use default no-op impl
     // of PrintRefs for Strings.
@@ -195,8 +294,11 @@ class FindReferencesCmd : public CommandBase {
 
     ReferencesVector* GetReferences() override;
 
-    void ScanRefs(v8::JSObject& js_obj, Error& err) override;
-    void ScanRefs(v8::String& str, Error& err) override;
+    void ScanRefs(v8::JSObject& js_obj, ReferenceBucket& bucket,
+                  Error& err) override;
+    void ScanRefs(v8::String& str, ReferenceBucket& bucket,
+                  Error& err) override;
+    void MergeRefs(ReferenceBucket& bucket) override;
 
     void PrintRefs(lldb::SBCommandReturnObject& result, v8::JSObject& js_obj,
                    Error& err, int level = 0) override;
@@ -215,6 +317,48 @@ class FindReferencesCmd : public CommandBase {
   LLScan* llscan_;  // FindReferencesCmd::llscan_
 };
 
+// Prints the shortest paths through the reference graph from the values
+// llnode knows are always alive to a given value.
+class FindRootsCmd : public CommandBase {
+ public:
+  FindRootsCmd(LLScan* llscan, node::Node* node)
+      : llscan_(llscan), node_(node) {}
+  ~FindRootsCmd() override {}
+
+  enum RootKind { kNativeContext, kGlobalObject, kHandleWrap, kReqWrap };
+  typedef std::unordered_map<uint64_t, RootKind> RootMap;
+
+  struct Options {
+    Options() : max_paths(5), max_depth(0), timeout(30) {}
+
+    int max_paths;
+    // Longest path to look for, 0 means no limit.
+    int max_depth;
+    // In seconds, 0 means no limit.
+    int timeout;
+  };
+
+  bool DoExecute(lldb::SBDebugger d, char** cmd,
+                 lldb::SBCommandReturnObject& result) override;
+
+  // Returns nullptr for unknown options.
+  char** ParseOptions(char** cmd, Options* options);
+
+  static const char* GetRootName(RootKind kind);
+
+ private:
+  // Fills `roots` and adds the references of roots which aren't instances,
+  // global objects, to `root_edges`.
+  void LoadRoots(lldb::SBTarget target, RootMap* roots,
+                 ReferenceGraph* root_edges);
+  void PrintPaths(lldb::SBCommandReturnObject& result, const Options& options,
+                  const RootMap& roots, const ReferenceGraph& root_edges,
+                  uint64_t address);
+
+  LLScan* llscan_;
+  node::Node* node_;
+};
+
 class MemoryVisitor {
  public:
   virtual ~MemoryVisitor() {}
@@ -224,24 +368,110 @@ class MemoryVisitor {
 
 class DetailedTypeRecord;
 
+// Addresses of the instances of a type, in increasing order. Stored either as
+// a plain vector or, to save memory on big heaps, as varint encoded deltas.
+// Lists loaded from a heap index point into the mapped file instead.
+class InstanceList {
+ public:
+  class iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef uint64_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const uint64_t* pointer;
+    typedef uint64_t reference;
+
+    iterator(const InstanceList* list, size_t pos);
+
+    inline uint64_t operator*() const {
+      return list_->compressed_ ? value_ : list_->addresses_data_[pos_];
+    }
+    iterator& operator++();
+    inline iterator operator++(int) {
+      iterator it = *this;
+      ++(*this);
+      return it;
+    }
+    inline bool operator==(const iterator& other) const {
+      return pos_ == other.pos_;
+    }
+    inline bool operator!=(const iterator& other) const {
+      return pos_ != other.pos_;
+    }
+
+   private:
+    void Decode();
+
+    const InstanceList* list_;
+    // Index into addresses_data_, or offset of the current value into
+    // deltas_data_.
+    size_t pos_;
+    size_t next_;
+    uint64_t value_;
+  };
+
+  InstanceList()
+      : addresses_data_(nullptr),
+        deltas_data_(nullptr),
+        length_(0),
+        size_(0),
+        compressed_(false) {}
+  InstanceList(const InstanceList&) = delete;
+  InstanceList& operator=(const InstanceList&) = delete;
+
+  // `addresses` must be sorted and unique.
+  void Assign(std::vector<uint64_t>&& addresses, bool compress);
+
+  inline iterator begin() const { return iterator(this, 0); }
+  inline iterator end() const {
+    return iterator(this, length_);
+  }
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+
+ private:
+  friend class HeapIndex;
+  std::vector<uint64_t> addresses_;
+  std::vector<uint8_t> deltas_;
+  // Point at the vectors above, or at memory owned by a HeapIndex.
+  const uint64_t* addresses_data_;
+  const uint8_t* deltas_data_;
+  // Number of addresses, or of bytes when compressed.
+  size_t length_;
+  size_t size_;
+  bool compressed_;
+};
+
 class TypeRecord {
  public:
   TypeRecord(std::string& type_name)
-      : type_name_(type_name), instance_count_(0), total_instance_size_(0) {}
+      : type_name_(type_name),
+        instance_count_(0),
+        total_instance_size_(0),
+        compact_at_(kMinCompactSize) {}
 
   inline std::string& GetTypeName() { return type_name_; };
+  // Counts and instances are only available once the record is finalized.
   inline uint64_t GetInstanceCount() { return instance_count_; };
   inline uint64_t GetTotalInstanceSize() { return total_instance_size_; };
-  inline std::unordered_set<uint64_t>& GetInstances() { return instances_; };
+  inline const InstanceList& GetInstances() { return instances_; };
 
+  // The same object may be added more than once while scanning.
   inline void AddInstance(uint64_t address, uint64_t size) {
-    auto result = instances_.insert(address);
-    if (result.second) {
-      instance_count_++;
-      total_instance_size_ += size;
+    if ((address & ~kAddressMask) != 0 || (size >> (64 - kSizeShift)) != 0) {
+      unpacked_.push_back({address, size});
+      return;
     }
+    pending_.push_back(address | (size << kSizeShift));
+    if (pending_.size() >= compact_at_) Compact();
   };
 
+  // Moves the instances found by another scan worker into this record.
+  void Merge(TypeRecord* other);
+
+  // Drops duplicates and computes counts once every instance was added.
+  void Finalize(bool compress);
+
   /* Sort records by instance count, use the other fields as tie breakers
    * to give consistent ordering.
    */
@@ -257,11 +487,26 @@ class TypeRecord {
 
 
  private:
+  // While scanning, instance sizes are kept in the upper bits of their
+  // addresses. User space addresses fit in 48 bits on every platform we
+  // support, which leaves 16 bits for the size in bytes. Larger instances, and
+  // addresses above 48 bits, go to unpacked_.
+  static const int kSizeShift = 48;
+  static const uint64_t kAddressMask = (1ULL << kSizeShift) - 1;
+  static const size_t kMinCompactSize = 1 << 16;
+
+  // Sorts and deduplicates pending_.
+  void Compact();
+
   friend class DetailedTypeRecord;
+  friend class HeapIndex;
   std::string type_name_;
   uint64_t instance_count_;
   uint64_t total_instance_size_;
-  std::unordered_set<uint64_t> instances_;
+  std::vector<uint64_t> pending_;
+  std::vector<std::pair<uint64_t, uint64_t>> unpacked_;
+  size_t compact_at_;
+  InstanceList instances_;
 };
 
 class DetailedTypeRecord : public TypeRecord {
@@ -282,18 +527,267 @@ class DetailedTypeRecord : public TypeRecord {
   uint64_t indexed_properties_count_;
 };
 
-typedef std::map<std::string, TypeRecord*> TypeRecordMap;
-typedef std::map<std::string, DetailedTypeRecord*> DetailedTypeRecordMap;
+// Type records keyed by name. Each name is interned into a dense id when it's
+// first seen, records live in a vector indexed by that id and only the
+// interning goes through a hash table. Iteration is in id (insertion) order,
+// use SortedByName() when the output needs a stable order.
+template <class Record>
+class TypeRecordTable {
+ public:
+  static const uint32_t kNotFound = UINT32_MAX;
+  typedef typename std::vector<Record*>::const_iterator const_iterator;
+
+  // Returns the id for `name`, adding an empty slot for it if it's new.
+  uint32_t Intern(const std::string& name) {
+    auto it = ids_.find(name);
+    if (it != ids_.end()) return it->second;
+
+    uint32_t id = names_.size();
+    ids_.emplace(name, id);
+    names_.push_back(name);
+    records_.push_back(nullptr);
+    return id;
+  }
+
+  uint32_t FindId(const std::string& name) const {
+    auto it = ids_.find(name);
+    return it == ids_.end() ? kNotFound : it->second;
+  }
+
+  Record* Find(const std::string& name) const {
+    uint32_t id = FindId(name);
+    return id == kNotFound ? nullptr : records_[id];
+  }
+
+  inline Record*& operator[](const std::string& name) {
+    return records_[Intern(name)];
+  }
+  inline Record*& Get(uint32_t id) { return records_[id]; }
+  inline Record* Get(uint32_t id) const { return records_[id]; }
+  inline const std::string& GetName(uint32_t id) const { return names_[id]; }
+
+  inline const_iterator begin() const { return records_.begin(); }
+  inline const_iterator end() const { return records_.end(); }
+  inline size_t size() const { return records_.size(); }
+  inline bool empty() const { return records_.empty(); }
+
+  void clear() {
+    ids_.clear();
+    names_.clear();
+    records_.clear();
+  }
+
+  std::vector<Record*> SortedByName() const {
+    std::vector<uint32_t> ids(records_.size());
+    for (uint32_t id = 0; id < ids.size(); id++) ids[id] = id;
+    std::sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) {
+      return names_[a] < names_[b];
+    });
+
+    std::vector<Record*> sorted;
+    sorted.reserve(ids.size());
+    for (uint32_t id : ids) sorted.push_back(records_[id]);
+    return sorted;
+  }
+
+ private:
+  std::unordered_map<std::string, uint32_t> ids_;
+  std::vector<std::string> names_;
+  std::vector<Record*> records_;
+};
+
+typedef TypeRecordTable<TypeRecord> TypeRecordMap;
+typedef TypeRecordTable<DetailedTypeRecord> DetailedTypeRecordMap;
+
+// Counters describing how a heap scan went.
+struct ScanStats {
+  uint64_t map_cache_hits = 0;
+  uint64_t map_cache_misses = 0;
+  // Time spent in each phase of the scan, summed over threads.
+  double read_seconds = 0;
+  double wait_seconds = 0;
+  double visit_seconds = 0;
+
+  void Merge(const ScanStats& other) {
+    map_cache_hits += other.map_cache_hits;
+    map_cache_misses += other.map_cache_misses;
+    read_seconds += other.read_seconds;
+    wait_seconds += other.wait_seconds;
+    visit_seconds += other.visit_seconds;
+  }
+};
+
+// Objects found by a FindJSObjectsVisitor. Each scan worker fills its own
+// ScanResults, which are merged into LLScan once every worker is done.
+struct ScanResults {
+  TypeRecordMap mapstoinstances;
+  DetailedTypeRecordMap detailedmapstoinstances;
+  ContextVector contexts;
+  ScanStats stats;
+};
+
+// Open-addressing hash set of non-zero addresses. Once built it is only read,
+// so it can be shared between scan workers.
+class AddressSet {
+ public:
+  AddressSet() : size_(0), shift_(64) {}
+
+  void Insert(uint64_t address);
+  inline bool Contains(uint64_t address) const {
+    if (size_ == 0) return false;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = HashSlot(address, shift_);; i = (i + 1) & mask) {
+      if (slots_[i] == address) return true;
+      if (slots_[i] == 0) return false;
+    }
+  }
+  inline size_t size() const { return size_; }
+
+  // Fibonacci hashing, the upper bits of the product are the well mixed ones.
+  static inline size_t HashSlot(uint64_t address, unsigned int shift) {
+    return static_cast<size_t>((address * 0x9e3779b97f4a7c15ULL) >> shift);
+  }
+
+ private:
+  void Grow();
+
+  std::vector<uint64_t> slots_;
+  size_t size_;
+  unsigned int shift_;
+};
+
+// Open-addressing hash map from non-zero addresses to indexes into some other
+// container.
+class AddressIndex {
+ public:
+  static const uint32_t kNotFound = UINT32_MAX;
+
+  AddressIndex() : size_(0), shift_(64) {}
+
+  void Insert(uint64_t address, uint32_t index);
+  inline uint32_t Find(uint64_t address) const {
+    if (size_ == 0) return kNotFound;
+    size_t mask = slots_.size() - 1;
+    for (size_t i = AddressSet::HashSlot(address, shift_);;
+         i = (i + 1) & mask) {
+      if (slots_[i].address == address) return slots_[i].index;
+      if (slots_[i].address == 0) return kNotFound;
+    }
+  }
+
+ private:
+  struct Slot {
+    uint64_t address;
+    uint32_t index;
+  };
+
+  void Grow();
+
+  std::vector<Slot> slots_;
+  size_t size_;
+  unsigned int shift_;
+};
+
+// Reverse references between heap values in compressed sparse row form: the
+// edges pointing to a value are stored next to each other, in the order their
+// sources were added. Each edge carries a label saying which slot of the
+// source holds the reference.
+class ReferenceGraph {
+ public:
+  enum EdgeKind {
+    kElement = 0,
+    // Payload is a name id, see GetName().
+    kProperty = 1,
+    kContextVariable = 2,
+    // Payload is an InternalField.
+    kInternal = 3
+  };
+  enum InternalField { kParent = 0, kFirst = 1, kSecond = 2, kActual = 3 };
+
+  // Payload of edges whose element index or name isn't known.
+  static const uint32_t kUnknownPayload = (1U << 30) - 1;
+
+  ReferenceGraph() : loaded_(false) {}
+  ReferenceGraph(const ReferenceGraph&) = delete;
+  ReferenceGraph& operator=(const ReferenceGraph&) = delete;
+
+  // A reference as found in the heap, before names are numbered: the payload
+  // of kProperty and kContextVariable references is the name's address.
+  struct Reference {
+    uint64_t source;
+    uint64_t target;
+    uint64_t payload;
+    EdgeKind kind;
+  };
+
+  // Edges of a source must be added one after the other, queries then find
+  // them next to each other.
+  void AddReference(const Reference& reference);
+  void AddEdge(uint64_t source, uint64_t target, EdgeKind kind,
+               uint64_t payload);
+  // Returns the payload for edges named after the string `name`.
+  uint32_t AddName(uint64_t name);
+  // Builds the graph from the added edges.
+  void Finalize();
+  void Clear();
+
+  inline bool IsLoaded() const { return loaded_; }
+  inline size_t GetNodeCount() const { return targets_.size(); }
+  inline size_t GetEdgeCount() const { return sources_.size(); }
+  size_t GetMemoryUsage() const;
+
+  // Sets [`begin`, `end`) to the indexes of the edges pointing to `target`.
+  void FindEdges(uint64_t target, size_t* begin, size_t* end) const;
+  inline uint64_t GetSource(size_t edge) const { return sources_[edge]; }
+  inline EdgeKind GetKind(size_t edge) const {
+    return static_cast<EdgeKind>(labels_[edge] >> 30);
+  }
+  inline uint32_t GetPayload(size_t edge) const {
+    return labels_[edge] & kUnknownPayload;
+  }
+  // Address of the string a kProperty or kContextVariable payload refers to.
+  inline uint64_t GetName(uint32_t payload) const { return names_[payload]; }
+
+ private:
+  struct PendingEdge {
+    uint64_t source;
+    // Index into pending_targets_.
+    uint32_t target;
+    uint32_t label;
+  };
+
+  std::vector<PendingEdge> pending_;
+  std::vector<uint64_t> pending_targets_;
+  AddressIndex pending_target_ids_;
+  AddressIndex name_ids_;
+
+  // Sorted, offsets_[i] is the first edge pointing to targets_[i].
+  std::vector<uint64_t> targets_;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint64_t> sources_;
+  std::vector<uint32_t> labels_;
+  std::vector<uint64_t> names_;
+  bool loaded_;
+};
 
 class FindJSObjectsVisitor : MemoryVisitor {
  public:
-  FindJSObjectsVisitor(lldb::SBTarget& target, LLScan* llscan);
+  FindJSObjectsVisitor(lldb::SBTarget& target, LLScan* llscan,
+                       ScanResults* results, const HeapScanOptions& options,
+                       const AddressSet* known_maps = nullptr);
   ~FindJSObjectsVisitor() {}
 
   uint64_t Visit(uint64_t location, uint64_t word);
+  // Same as above, decoding objects with `layout`.
+  template <class Layout>
+  uint64_t Visit(const Layout& layout, uint64_t location, uint64_t word);
 
   uint32_t FoundCount() { return found_count_; }
 
+  // Objects skipped as a whole can't extend past `end`, the end of the memory
+  // region being visited.
+  inline void SetRegionEnd(uint64_t end) { region_end_ = end; }
+
  private:
   // TODO (mmarchini): this could be an option for findjsobjects
   static const size_t kNumberOfPropertiesForDetailedOutput = 3;
@@ -301,10 +795,27 @@ class FindJSObjectsVisitor : MemoryVisitor {
   struct MapCacheEntry {
     enum ShowArrayLength { kShowArrayLength, kDontShowArrayLength };
 
+    // How the size of objects using this map is found.
+    enum SizeKind {
+      kFixedSize,
+      kSeqOneByteString,
+      kSeqTwoByteString,
+      kFixedArray,
+      kByteArray,
+      kUnknownSize
+    };
+
     std::string type_name;
     bool is_histogram;
     bool is_context;
 
+    int64_t instance_size = 0;
+    SizeKind size_kind = kUnknownSize;
+
+    // Records objects using this map are added to, resolved on first use.
+    TypeRecord* type_record = nullptr;
+    DetailedTypeRecord* detailed_type_record = nullptr;
+
     std::vector<std::string> properties_;
     uint64_t own_descriptors_count_ = 0;
     uint64_t indexed_properties_count_ = 0;
@@ -315,16 +826,32 @@ class FindJSObjectsVisitor : MemoryVisitor {
 
     bool Load(v8::Map map, v8::HeapObject heap_object, v8::LLV8* llv8,
               Error& err);
+
+    static SizeKind GetVariableSizeKind(int64_t type, v8::LLV8* llv8);
   };
 
   static bool IsAHistogramType(v8::Map& map, Error& err);
 
+  template <class Layout>
+  uint64_t VisitObjectStart(const Layout& layout, uint64_t location,
+                            uint64_t word);
+  template <class Layout>
+  inline bool LoadMapWord(const Layout& layout, int64_t object, int64_t* map);
+  template <class Layout>
+  inline bool IsMap(const Layout& layout, int64_t object);
+  MapCacheEntry* GetMapCacheEntry(v8::Map map, v8::HeapObject heap_object,
+                                  Error& err);
+  template <class Layout>
+  int64_t GetObjectSize(const Layout& layout, v8::HeapObject heap_object,
+                        MapCacheEntry& map_info);
+  void RecordObject(uint64_t word, MapCacheEntry& map_info);
+
   void InsertOnContexts(uint64_t word, Error& err);
-  void InsertOnMapsToInstances(uint64_t word, v8::Map map,
-                               FindJSObjectsVisitor::MapCacheEntry map_info,
+  void InsertOnMapsToInstances(uint64_t word,
+                               FindJSObjectsVisitor::MapCacheEntry& map_info,
                                Error& err);
   void InsertOnDetailedMapsToInstances(
-      uint64_t word, v8::Map map, FindJSObjectsVisitor::MapCacheEntry map_info,
+      uint64_t word, FindJSObjectsVisitor::MapCacheEntry& map_info,
       Error& err);
 
   lldb::SBTarget& target_;
@@ -332,18 +859,133 @@ class FindJSObjectsVisitor : MemoryVisitor {
   uint32_t found_count_;
 
   LLScan* const llscan_;
-  std::map<int64_t, MapCacheEntry> map_cache_;
+  ScanResults* const results_;
+  const AddressSet* const known_maps_;
+  HeapScanOptions::ScanMode scan_mode_;
+  uint64_t region_end_;
+  const v8::layouts::Dynamic dynamic_layout_;
+  const int64_t map_type_;
+
+  // Entries are looked up by map address through map_cache_index_.
+  std::vector<MapCacheEntry> map_cache_;
+  AddressIndex map_cache_index_;
+};
+
+// A range of process memory, [start, end).
+struct MemoryRange {
+  uint64_t start;
+  uint64_t end;
+  // End of the memory region the range is part of.
+  uint64_t region_end;
+};
+
+// Cheap test which discards words that can't point to a heap object before
+// they reach the visitor: the word must carry the heap object tag and point
+// into readable process memory. Blocks are filtered with SSE2/AVX2 when
+// available.
+class PointerPrefilter {
+ public:
+  void Load(lldb::SBProcess process, v8::LLV8* llv8);
+
+  // Stores into `candidates` the offsets of the words in `block` which pass
+  // the filter, in increasing order.
+  void Filter(const unsigned char* block, size_t size,
+              std::vector<uint32_t>& candidates) const;
+
+  inline uint64_t LoadWord(const unsigned char* block, size_t offset) const;
+  inline uint32_t GetAddressSize() const { return addr_size_; }
+
+ private:
+  bool IsMapped(uint64_t word) const;
+
+  uint32_t addr_size_;
+  bool swap_bytes_;
+  uint64_t tag_mask_;
+  uint64_t tag_;
+
+  // Sorted, non-overlapping readable ranges and their bounds.
+  std::vector<MemoryRange> ranges_;
+  uint64_t low_;
+  uint64_t high_;
+};
+
+// Hands the blocks of the scan chunks to the workers. With read-ahead, a
+// reader thread loads blocks into a ring shared by the workers while they
+// visit the previous ones, so that reading memory and visiting objects
+// overlap. Without it, workers load their own blocks.
+//
+// The reader loads chunks in order and workers must take chunks in the same
+// order, and the blocks of a chunk one after another.
+class ScanReader {
+ public:
+  struct Block {
+    uint64_t address;
+    uint64_t size;
+    // Null if the block couldn't be read, the rest of the chunk is skipped.
+    const unsigned char* data;
+
+   private:
+    friend class ScanReader;
+    enum State { kFree, kLoading, kLoaded, kInUse };
+
+    size_t chunk;
+    size_t index;
+    State state;
+    unsigned char* buffer;
+  };
+
+  ScanReader(LLScan* llscan, const std::vector<MemoryRange>& chunks,
+             uint64_t block_size, size_t workers, size_t read_ahead);
+  ~ScanReader();
+
+  inline const MemoryRange& GetChunk(size_t chunk) const {
+    return chunks_[chunk];
+  }
+  inline size_t GetBlockCount(size_t chunk) const {
+    const MemoryRange& range = chunks_[chunk];
+    return (range.end - range.start + block_size_ - 1) / block_size_;
+  }
+
+  // Returns block `index` of `chunk`, waiting for it to be loaded if needed.
+  // Workers must release a block before acquiring the next one.
+  const Block* Acquire(size_t worker, size_t chunk, size_t index,
+                       ScanStats& stats);
+  void Release(const Block* block);
+  // Releases the remaining blocks of a chunk nobody wants to visit.
+  void Skip(size_t worker, size_t chunk, size_t index, ScanStats& stats);
+
+  inline double GetReadSeconds() const { return read_seconds_; }
+
+ private:
+  // Returns how long it took, in seconds.
+  double Load(Block& block, size_t chunk, size_t index);
+  void Run();
+
+  LLScan* llscan_;
+  const std::vector<MemoryRange>& chunks_;
+  uint64_t block_size_;
+  // One per worker without read-ahead, the ring otherwise.
+  std::vector<Block> blocks_;
+  bool pipelined_;
+  std::thread reader_;
+  std::mutex mutex_;
+  std::condition_variable loaded_;
+  std::condition_variable released_;
+  bool stop_;
+  double read_seconds_;
 };
 
 
 class LLScan {
  public:
-  LLScan(v8::LLV8* llv8) : llv8_(llv8) {}
+  LLScan(v8::LLV8* llv8);
+  ~LLScan();
 
   v8::LLV8* v8() { return llv8_; }
 
   bool ScanHeapForObjects(lldb::SBTarget target,
-                          lldb::SBCommandReturnObject& result);
+                          lldb::SBCommandReturnObject& result,
+                          const HeapScanOptions& options = HeapScanOptions());
 
   inline TypeRecordMap& GetMapsToInstances() { return mapstoinstances_; };
   inline DetailedTypeRecordMap& GetDetailedMapsToInstances() {
@@ -351,15 +993,15 @@ class LLScan {
   };
 
   // References By Value
-  inline bool AreReferencesByValueLoaded() {
-    return references_by_value_.size() > 0;
-  };
-  inline ReferencesVector* GetReferencesByValue(uint64_t address) {
-    if (references_by_value_.count(address) == 0) {
-      references_by_value_[address] = new ReferencesVector;
-    }
-    return references_by_value_[address];
-  };
+  inline const ReferenceGraph& GetReferenceGraph() { return reference_graph_; }
+  void BuildReferenceGraph();
+
+  // Calls `visit(address, bucket)` for every instance found by the heap scan
+  // on `jobs` threads (0 means one per core). Instances are handed out in
+  // batches, each with a new Bucket which is passed to `merge(bucket)` in
+  // the order SortedByName() lists the instances.
+  template <class Bucket, class Visit, class Merge>
+  void VisitInstances(size_t jobs, Visit visit, Merge merge);
 
   // References By Property
   inline bool AreReferencesByPropertyLoaded() {
@@ -376,33 +1018,70 @@ class LLScan {
   inline bool AreReferencesByStringLoaded() {
     return references_by_string_.size() > 0;
   };
-  inline ReferencesVector* GetReferencesByString(std::string string_value) {
-    if (references_by_string_.count(string_value) == 0) {
-      references_by_string_[string_value] = new ReferencesVector;
-    }
-    return references_by_string_[string_value];
+  inline ReferencesVector* GetReferencesByString(uint64_t string_hash) {
+    ReferencesVector*& references = references_by_string_[string_hash];
+    if (references == nullptr) references = new ReferencesVector;
+    return references;
   };
 
   // Contexts
   inline bool AreContextsLoaded() { return contexts_.size() > 0; };
   inline ContextVector* GetContexts() { return &contexts_; }
+  inline const ScanStats& GetScanStats() { return scan_stats_; }
 
   v8::LLV8* llv8_;
 
  private:
-  void ScanMemoryRegions(FindJSObjectsVisitor& v);
+  friend class FindRootsCmd;
+  friend class ScanReader;
+
+  // Number of scan blocks handed to a worker at once.
+  static const uint64_t kBlocksPerChunk = 4;
+
+  void ScanMemoryRegions(lldb::SBTarget& target,
+                         const HeapScanOptions& options);
+  std::vector<MemoryRange> GetScanChunks(uint64_t chunk_size);
+  uint64_t FindMetaMap(const std::vector<MemoryRange>& chunks,
+                       const PointerPrefilter& prefilter, unsigned char* block,
+                       uint64_t block_size);
+  void FindMapsInRange(size_t chunk, ScanReader& reader, size_t worker,
+                       const PointerPrefilter& prefilter, ScanStats& stats,
+                       std::vector<uint64_t>& meta_maps,
+                       std::vector<uint64_t>& maps);
+  const unsigned char* LoadBlock(uint64_t address, uint64_t size,
+                                 unsigned char* block);
+  template <class Layout>
+  void ScanMemoryRange(const Layout& layout, FindJSObjectsVisitor& v,
+                       size_t chunk, ScanReader& reader, size_t worker,
+                       const PointerPrefilter& prefilter, ScanStats& stats);
+  std::string GetHeapIndexPath();
+  HeapIndexKey GetHeapIndexKey(const HeapScanOptions& options);
+  bool LoadHeapIndex(const std::string& path, const HeapIndexKey& key);
+  void SaveHeapIndex(const std::string& path, const HeapIndexKey& key);
+  void MergeScanResults(ScanResults& results);
+  void FinalizeScanResults(const HeapScanOptions& options, size_t jobs);
   void ClearMapsToInstances();
   void ClearReferences();
+  void AddObjectReferences(v8::JSObject& js_obj,
+                           std::vector<ReferenceGraph::Reference>& bucket);
+  void AddStringReferences(v8::String& str,
+                           std::vector<ReferenceGraph::Reference>& bucket);
+  void AddContextReferences(uint64_t context,
+                            std::vector<ReferenceGraph::Reference>& bucket);
 
   lldb::SBTarget target_;
   lldb::SBProcess process_;
   TypeRecordMap mapstoinstances_;
   DetailedTypeRecordMap detailedmapstoinstances_;
 
-  ReferencesByValueMap references_by_value_;
+  ReferenceGraph reference_graph_;
   ReferencesByPropertyMap references_by_property_;
   ReferencesByStringMap references_by_string_;
   ContextVector contexts_;
+  ScanStats scan_stats_;
+  // Mode the current results were scanned with.
+  HeapScanOptions::ScanMode scan_mode_;
+  std::unique_ptr<HeapIndex> heap_index_;
 };
 
 }  // namespace llnode
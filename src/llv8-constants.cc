@@ -275,6 +275,10 @@ void Context::Load() {
     kNativeIndex = LoadConstant("class_Context__native_context_index__int");
   }
   kEmbedderDataIndex = LoadConstant("context_idx_embedder_data", (int)5);
+  // Native contexts keep their global object in the extension slot, which
+  // follows the previous context.
+  kGlobalObjectIndex = LoadConstant(
+      "context_idx_extension", kPreviousIndex == -1 ? -1 : kPreviousIndex + 1);
 
   kMinContextSlots = LoadConstant("class_Context__min_context_slots__int",
                                   "context_min_slots");
@@ -524,6 +528,21 @@ void NameDictionary::Load() {
   kPrefixSize = LoadConstant("class_NameDictionaryShape__prefix_size__int",
                              "namedictionaryshape_prefix_size") +
                 kPrefixStartIndex;
+
+  kGlobalEntrySize =
+      LoadConstant("class_GlobalDictionaryShape__entry_size__int",
+                   "globaldictionaryshape_entry_size", 1);
+}
+
+
+void PropertyCell::Load() {
+  common_->Load();
+  // A PropertyCell holds its name, its property details and its value, in
+  // that order.
+  kNameOffset = LoadConstant("class_PropertyCell__name__Name",
+                             common_->kPointerSize);
+  kValueOffset = LoadConstant("class_PropertyCell__value__Object",
+                              common_->kPointerSize * 3);
 }
 
 
@@ -601,6 +620,7 @@ void Types::Load() {
   kCodeType = LoadConstant("type_Code__CODE_TYPE");
   kJSFunctionType = LoadConstant("type_JSFunction__JS_FUNCTION_TYPE");
   kFixedArrayType = LoadConstant("type_FixedArray__FIXED_ARRAY_TYPE");
+  kByteArrayType = LoadConstant("type_ByteArray__BYTE_ARRAY_TYPE");
   kJSArrayBufferType = LoadConstant("type_JSArrayBuffer__JS_ARRAY_BUFFER_TYPE");
   kJSTypedArrayType = LoadConstant("type_JSTypedArray__JS_TYPED_ARRAY_TYPE");
   kJSRegExpType = LoadConstant("type_JSRegExp__JS_REGEXP_TYPE");
@@ -620,6 +640,7 @@ void Types::Load() {
   kScriptType = LoadConstant("type_Script__SCRIPT_TYPE");
   kScopeInfoType = LoadConstant("type_ScopeInfo__SCOPE_INFO_TYPE");
   kSymbolType = LoadConstant("type_Symbol__SYMBOL_TYPE");
+  kPropertyCellType = LoadConstant("type_PropertyCell__PROPERTY_CELL_TYPE");
 
   if (kJSAPIObjectType == -1) {
     common_->Load();
@@ -477,6 +477,21 @@ class NameDictionary : public Module {
   int64_t kPrefixStartIndex;
   int64_t kPrefixSize;
 
+  // Global objects' GlobalDictionary shares the prefix, but each of its
+  // entries is a single PropertyCell.
+  int64_t kGlobalEntrySize;
+
+ protected:
+  void Load();
+};
+
+class PropertyCell : public Module {
+ public:
+  CONSTANTS_DEFAULT_METHODS(PropertyCell);
+
+  int64_t kNameOffset;
+  int64_t kValueOffset;
+
  protected:
   void Load();
 };
@@ -540,6 +555,7 @@ class Types : public Module {
   int64_t kCodeType;
   int64_t kJSFunctionType;
   int64_t kFixedArrayType;
+  int64_t kByteArrayType;
   int64_t kJSArrayBufferType;
   int64_t kJSTypedArrayType;
   int64_t kJSRegExpType;
@@ -550,6 +566,7 @@ class Types : public Module {
   int64_t kScriptType;
   int64_t kScopeInfoType;
   int64_t kSymbolType;
+  int64_t kPropertyCellType;
 
  protected:
   void Load();
@@ -21,13 +21,10 @@ inline std::string CheckedType<T>::ToString(const char* fmt) {
 
 template <class T>
 inline CheckedType<T> LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size) {
-  SBError sberr;
-  int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
-                                                  byte_size, sberr);
-
-  if (sberr.Fail()) {
-    PRINT_DEBUG("Failed to load unsigned from v8 memory. Reason: %s",
-                sberr.GetCString());
+  uint64_t value;
+  if (!ReadUnsigned(addr, byte_size, &value)) {
+    PRINT_DEBUG("Failed to load unsigned from v8 memory, addr=0x%016" PRIx64,
+                addr);
     return CheckedType<T>();
   }
 
@@ -60,7 +57,7 @@ inline T LLV8::LoadValue(int64_t addr, Error& err) {
   if (!res.Check()) {
     // TODO(joyeecheung): use Error::Failure() to report information when
     // there is less noise from here.
-    err = Error(true, "Invalid value");
+    err = Error(Error::kInvalidValue, "Invalid value");
     return T();
   }
 
@@ -78,6 +75,11 @@ inline int64_t Smi::GetValue() const {
 }
 
 
+inline HeapObject HeapObject::FromAddress(LLV8* v8, int64_t address) {
+  return HeapObject(v8, address + v8->heap_obj()->kTag);
+}
+
+
 inline bool HeapObject::Check() const {
   return valid_ &&
          (raw() & v8()->heap_obj()->kTagMask) == v8()->heap_obj()->kTag;
@@ -95,10 +97,17 @@ inline int64_t HeapObject::LoadField(int64_t off, Error& err) {
 
 
 template <typename T>
-inline CheckedType<T> HeapObject::LoadCheckedField(Constant<int64_t> off) {
+inline CheckedType<T> HeapObject::LoadCheckedField(int64_t off) {
   RETURN_IF_THIS_INVALID(CheckedType<T>());
+  return v8()->LoadUnsigned<T>(LeaField(off), 8);
+}
+
+
+template <typename T>
+inline CheckedType<T> HeapObject::LoadCheckedField(
+    const Constant<int64_t>& off) {
   RETURN_IF_INVALID(off, CheckedType<T>());
-  return v8()->LoadUnsigned<T>(LeaField(*off), 8);
+  return LoadCheckedField<T>(*off);
 }
 
 
@@ -810,18 +819,8 @@ inline std::string TwoByteString::ToString(Error& err) {
 }
 
 inline std::string ConsString::ToString(Error& err) {
-  String first = First(err);
-  if (err.Fail()) return std::string();
-
-  String second = Second(err);
-  if (err.Fail()) return std::string();
-
-  std::string tmp = first.ToString(err);
-  if (err.Fail()) return std::string();
-  tmp += second.ToString(err);
-  if (err.Fail()) return std::string();
-
-  return tmp;
+  bool truncated;
+  return ToString(0, &truncated, err);
 }
 
 inline std::string SlicedString::ToString(Error& err) {
@@ -993,6 +992,24 @@ inline int64_t NameDictionary::Length(Error& err) {
   return res;
 }
 
+inline HeapObject GlobalDictionary::GetCell(int index, Error& err) {
+  int64_t off = v8()->name_dictionary()->kPrefixSize +
+                index * v8()->name_dictionary()->kGlobalEntrySize;
+  return FixedArray::Get<HeapObject>(off, err);
+}
+
+inline int64_t GlobalDictionary::Length(Error& err) {
+  Smi length = FixedArray::Length(err);
+  if (err.Fail()) return -1;
+
+  int64_t res = length.GetValue() - v8()->name_dictionary()->kPrefixSize;
+  res /= v8()->name_dictionary()->kGlobalEntrySize;
+  return res;
+}
+
+ACCESSOR(PropertyCell, Name, property_cell()->kNameOffset, Value)
+ACCESSOR(PropertyCell, CellValue, property_cell()->kValueOffset, Value)
+
 inline JSFunction Context::Closure(Error& err) {
   return FixedArray::Get<JSFunction>(v8()->context()->kClosureIndex, err);
 }
@@ -0,0 +1,80 @@
+#include "src/llv8-layouts.h"
+#include "src/llv8.h"
+
+namespace llnode {
+namespace v8 {
+namespace layouts {
+
+namespace {
+
+template <class Layout>
+bool Matches(const Dynamic& dynamic) {
+  return dynamic.valid && dynamic.kPointerSize == Layout::kPointerSize &&
+         dynamic.kSmiTag == Layout::kSmiTag &&
+         dynamic.kSmiTagMask == Layout::kSmiTagMask &&
+         dynamic.kSmiShiftSize == Layout::kSmiShiftSize &&
+         dynamic.kHeapObjectTag == Layout::kHeapObjectTag &&
+         dynamic.kHeapObjectTagMask == Layout::kHeapObjectTagMask &&
+         dynamic.kMapOffset == Layout::kMapOffset &&
+         dynamic.kMapInstanceTypeOffset == Layout::kMapInstanceTypeOffset &&
+         dynamic.kMapTypeMask == Layout::kMapTypeMask &&
+         dynamic.kFixedArrayLengthOffset == Layout::kFixedArrayLengthOffset &&
+         dynamic.kFixedArrayDataOffset == Layout::kFixedArrayDataOffset;
+}
+
+template <>
+bool Matches<Dynamic>(const Dynamic&) {
+  return false;
+}
+
+template <int Major>
+LayoutId SelectFor(const Dynamic& dynamic) {
+  typedef typename ForVersion<Major>::Layout Layout;
+  if (!Matches<Layout>(dynamic)) {
+    PRINT_DEBUG("No compile-time layout matches V8 %d", Major);
+    return kDynamic;
+  }
+  return Layout::kId;
+}
+
+}  // namespace
+
+
+Dynamic::Dynamic(LLV8* v8) {
+  version_major = v8->common()->kVersionMajor;
+  kPointerSize = v8->common()->kPointerSize;
+  kSmiTag = v8->smi()->kTag;
+  kSmiTagMask = v8->smi()->kTagMask;
+  kSmiShiftSize = v8->smi()->kShiftSize;
+  kHeapObjectTag = v8->heap_obj()->kTag;
+  kHeapObjectTagMask = v8->heap_obj()->kTagMask;
+  kMapOffset = v8->heap_obj()->kMapOffset;
+  kMapInstanceTypeOffset = *v8->map()->kInstanceAttrsOffset;
+  kMapTypeMask = v8->map()->kMapTypeMask;
+  kFixedArrayLengthOffset = v8->fixed_array_base()->kLengthOffset;
+  kFixedArrayDataOffset = v8->fixed_array()->kDataOffset;
+
+  valid = v8->map()->kInstanceAttrsOffset.Check() && kPointerSize > 0 &&
+          kHeapObjectTagMask != -1 && kSmiTagMask != -1 && kMapOffset != -1 &&
+          kFixedArrayLengthOffset != -1 && kFixedArrayDataOffset != -1;
+}
+
+
+LayoutId Select(const Dynamic& dynamic) {
+  switch (dynamic.version_major) {
+    case 6:
+      return SelectFor<6>(dynamic);
+    case 7:
+      return SelectFor<7>(dynamic);
+    case 8:
+      return SelectFor<8>(dynamic);
+    case 9:
+      return SelectFor<9>(dynamic);
+    default:
+      return kDynamic;
+  }
+}
+
+}  // namespace layouts
+}  // namespace v8
+}  // namespace llnode
@@ -0,0 +1,100 @@
+#ifndef SRC_LLV8_LAYOUTS_H_
+#define SRC_LLV8_LAYOUTS_H_
+
+#include <stdint.h>
+
+namespace llnode {
+namespace v8 {
+
+class LLV8;
+
+namespace layouts {
+
+// Object layouts known at compile time, for the parts of the heap the scan
+// decodes on every word: tags, the map pointer and a map's instance type, and
+// the header of FixedArrays. The scan is instantiated once per layout, so the
+// hot loop works with immediate values instead of reading constants::*
+// members and checking them on every object.
+//
+// A layout is only used after Select() compared each of its values with the
+// constants loaded from the target's debug symbols. Builds it doesn't match
+// (and versions without a layout) use Dynamic, which holds those constants.
+
+enum LayoutId { kDynamic, kFull64 };
+
+// 64-bit builds without pointer compression, which Node.js doesn't enable.
+struct Full64 {
+  static const LayoutId kId = kFull64;
+
+  static const int64_t kPointerSize = 8;
+  static const int64_t kSmiTag = 0;
+  static const int64_t kSmiTagMask = 1;
+  static const int64_t kSmiShiftSize = 31;
+  static const int64_t kHeapObjectTag = 1;
+  static const int64_t kHeapObjectTagMask = 3;
+  static const int64_t kMapOffset = 0;
+  static const int64_t kMapInstanceTypeOffset = 12;
+  static const int64_t kMapTypeMask = 0xffff;
+  static const int64_t kFixedArrayLengthOffset = 8;
+  static const int64_t kFixedArrayDataOffset = 16;
+};
+
+// Same values as above, read from the constants at runtime.
+struct Dynamic {
+  static const LayoutId kId = kDynamic;
+
+  explicit Dynamic(LLV8* v8);
+
+  int64_t version_major;
+  // False if a constant the scan needs is missing.
+  bool valid;
+
+  int64_t kPointerSize;
+  int64_t kSmiTag;
+  int64_t kSmiTagMask;
+  int64_t kSmiShiftSize;
+  int64_t kHeapObjectTag;
+  int64_t kHeapObjectTagMask;
+  int64_t kMapOffset;
+  int64_t kMapInstanceTypeOffset;
+  int64_t kMapTypeMask;
+  int64_t kFixedArrayLengthOffset;
+  int64_t kFixedArrayDataOffset;
+};
+
+// Layout expected for each V8 major line. Lines can share a layout, the scan
+// is instantiated once per distinct layout.
+template <int Major>
+struct ForVersion {
+  typedef Dynamic Layout;
+};
+
+template <>
+struct ForVersion<6> {
+  typedef Full64 Layout;
+};
+
+template <>
+struct ForVersion<7> {
+  typedef Full64 Layout;
+};
+
+template <>
+struct ForVersion<8> {
+  typedef Full64 Layout;
+};
+
+template <>
+struct ForVersion<9> {
+  typedef Full64 Layout;
+};
+
+// Returns the layout to scan the target's heap with: kDynamic unless the
+// layout of its V8 line matches every constant in `dynamic`.
+LayoutId Select(const Dynamic& dynamic);
+
+}  // namespace layouts
+}  // namespace v8
+}  // namespace llnode
+
+#endif  // SRC_LLV8_LAYOUTS_H_
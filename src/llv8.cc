@@ -1,9 +1,12 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cinttypes>
 #include <cstdarg>
 #include <iomanip>
+#include <iterator>
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -11,6 +14,7 @@
 #include "llv8-inl.h"
 #include "llv8.h"
 #include "src/settings.h"
+#include "src/utf16.h"
 
 namespace llnode {
 namespace v8 {
@@ -24,11 +28,18 @@ static std::string kConstantPrefix = "v8dbg_";
 void LLV8::Load(SBTarget target) {
   // Reload process anyway
   process_ = target.GetProcess();
+  memory_cache_.SetProcess(process_);
+  if (process_.IsValid()) {
+    address_byte_size_ = process_.GetAddressByteSize();
+    byte_order_ = process_.GetByteOrder();
+  }
+  LoadCoreFile();
 
   // No need to reload
   if (target_ == target) return;
 
   target_ = target;
+  ConstantCache::Open(target);
 
   common.Assign(target);
   smi.Assign(target, &common);
@@ -61,19 +72,254 @@ void LLV8::Load(SBTarget target) {
   js_date.Assign(target, &common);
   descriptor_array.Assign(target, &common);
   name_dictionary.Assign(target, &common);
+  property_cell.Assign(target, &common);
   frame.Assign(target, &common);
   symbol.Assign(target, &common);
   types.Assign(target, &common);
 }
 
-int64_t LLV8::LoadPtr(int64_t addr, Error& err) {
+void LLV8::LoadAllConstants() {
+  auto start = std::chrono::steady_clock::now();
+
+  common();
+  smi();
+  heap_obj();
+  map();
+  js_object();
+  heap_number();
+  js_array();
+  js_function();
+  shared_info();
+  uncompiled_data();
+  code();
+  scope_info();
+  context();
+  script();
+  string();
+  one_byte_string();
+  two_byte_string();
+  cons_string();
+  sliced_string();
+  thin_string();
+  fixed_array_base();
+  fixed_array();
+  fixed_typed_array_base();
+  js_typed_array();
+  oddball();
+  js_array_buffer();
+  js_array_buffer_view();
+  js_regexp();
+  js_date();
+  descriptor_array();
+  name_dictionary();
+  property_cell();
+  frame();
+  symbol();
+  types();
+
+  std::chrono::duration<double> time =
+      std::chrono::steady_clock::now() - start;
+  PRINT_DEBUG("Loaded V8 constants in %.3fs", time.count());
+}
+
+void MemoryCache::SetProcess(lldb::SBProcess process) {
+  uint32_t stop_id = process.IsValid() ? process.GetStopID() : 0;
+  bool stale = process_ != process || stop_id_ != stop_id;
+  process_ = process;
+  stop_id_ = stop_id;
+
+  uint64_t max_blocks =
+      static_cast<uint64_t>(Settings::GetSettings()->GetMemoryCacheSize()) *
+      1024 * 1024 / kBlockSize;
+  // Round up so that a small budget still caches something.
+  max_blocks_ = (max_blocks + kShardCount - 1) / kShardCount;
+
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (stale) {
+      shard.index.clear();
+      shard.blocks.clear();
+    }
+    // The budget may have been lowered since the last command.
+    while (shard.index.size() > max_blocks_) {
+      shard.index.erase(shard.blocks.back().address);
+      shard.blocks.pop_back();
+    }
+  }
+}
+
+
+bool MemoryCache::Read(uint64_t addr, void* buf, uint64_t size) {
+  if (max_blocks_ == 0 || size > kMaxCachedRead)
+    return ReadUncached(addr, buf, size);
+
+  uint8_t* out = static_cast<uint8_t*>(buf);
+  while (size > 0) {
+    uint64_t block_address = addr & ~(kBlockSize - 1);
+    uint64_t offset = addr - block_address;
+    uint64_t length = std::min(size, kBlockSize - offset);
+
+    // Blocks at the edge of a readable region may not load, fall back to
+    // reading exactly what was asked for.
+    if (!ReadBlock(block_address, offset, out, length))
+      return ReadUncached(addr, out, size);
+
+    out += length;
+    addr += length;
+    size -= length;
+  }
+  return true;
+}
+
+
+MemoryCache::Stats MemoryCache::GetStats() {
+  Stats stats;
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.hits += shard.hits;
+    stats.misses += shard.misses;
+  }
+  stats.uncached = uncached_;
+  return stats;
+}
+
+
+bool MemoryCache::ReadBlock(uint64_t block_address, uint64_t offset,
+                            uint8_t* out, uint64_t length) {
+  Shard& shard = GetShard(block_address);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(block_address);
+    if (it != shard.index.end()) {
+      shard.hits++;
+      shard.blocks.splice(shard.blocks.begin(), shard.blocks, it->second);
+      memcpy(out, it->second->data + offset, length);
+      return true;
+    }
+    shard.misses++;
+  }
+
+  uint8_t data[kBlockSize];
   SBError sberr;
-  int64_t value =
-      process_.ReadPointerFromMemory(static_cast<addr_t>(addr), sberr);
-  if (sberr.Fail()) {
+  if (process_.ReadMemory(block_address, data, kBlockSize, sberr) !=
+          kBlockSize ||
+      sberr.Fail()) {
+    return false;
+  }
+  memcpy(out, data + offset, length);
+
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  // Another worker may have loaded the same block meanwhile.
+  if (shard.index.find(block_address) != shard.index.end()) return true;
+
+  // Reuse the least recently used block once the budget is reached.
+  if (shard.index.size() >= max_blocks_) {
+    shard.index.erase(shard.blocks.back().address);
+    shard.blocks.splice(shard.blocks.begin(), shard.blocks,
+                        std::prev(shard.blocks.end()));
+  } else {
+    shard.blocks.emplace_front();
+  }
+
+  Block& block = shard.blocks.front();
+  block.address = block_address;
+  memcpy(block.data, data, kBlockSize);
+  shard.index[block_address] = shard.blocks.begin();
+  return true;
+}
+
+
+bool MemoryCache::ReadUncached(uint64_t addr, void* buf, uint64_t size) {
+  uncached_++;
+  SBError sberr;
+  size_t loaded = process_.ReadMemory(addr, buf, size, sberr);
+  return sberr.Success() && loaded == size;
+}
+
+
+std::string LLV8::GetCoreFile() {
+  if (!core_path_.empty()) return core_path_;
+  return Settings::GetSettings()->GetCoreFile();
+}
+
+
+void LLV8::LoadCoreFile() {
+  std::string path = GetCoreFile();
+  if (path == core_file_tried_ && process_ == core_file_process_) return;
+  core_file_tried_ = path;
+  core_file_process_ = process_;
+
+  core_file_.Close();
+  if (path.empty() || !process_.IsValid()) return;
+
+  Error err;
+  core_file_.Open(path, err);
+  if (err.Fail()) {
+    PRINT_DEBUG("Not mapping core file: %s", err.GetMessage());
+    return;
+  }
+
+  // Make sure this is the core lldb is looking at.
+  std::vector<std::pair<uint64_t, uint64_t>> regions;
+  lldb::SBMemoryRegionInfoList region_list = process_.GetMemoryRegions();
+  lldb::SBMemoryRegionInfo region_info;
+  for (uint32_t i = 0; i < region_list.GetSize(); i++) {
+    if (!region_list.GetMemoryRegionAtIndex(i, region_info)) continue;
+    regions.push_back(
+        {region_info.GetRegionBase(), region_info.GetRegionEnd()});
+  }
+  std::sort(regions.begin(), regions.end());
+
+  bool matches = core_file_.VerifySegments(regions, [this](uint64_t address,
+                                                           uint64_t size) {
+    uint8_t buf[64];
+    SBError sberr;
+    size = std::min<uint64_t>(size, sizeof(buf));
+    return process_.ReadMemory(address, buf, size, sberr) == size &&
+           sberr.Success() &&
+           memcmp(buf, core_file_.GetPointer(address, size), size) == 0;
+  });
+  if (!matches) {
+    PRINT_DEBUG("Core file '%s' doesn't match the process memory",
+                path.c_str());
+    core_file_.Close();
+  }
+}
+
+
+bool LLV8::ReadMemory(uint64_t addr, void* buf, uint64_t size) {
+  const uint8_t* mapped = core_file_.GetPointer(addr, size);
+  if (mapped != nullptr) {
+    memcpy(buf, mapped, size);
+    return true;
+  }
+  return memory_cache_.Read(addr, buf, size);
+}
+
+
+bool LLV8::ReadUnsigned(int64_t addr, uint32_t byte_size, uint64_t* value) {
+  uint8_t buf[sizeof(uint64_t)];
+  if (byte_size > sizeof(buf) ||
+      !ReadMemory(static_cast<uint64_t>(addr), buf, byte_size)) {
+    return false;
+  }
+
+  *value = 0;
+  for (uint32_t i = 0; i < byte_size; i++) {
+    uint32_t byte = byte_order_ == lldb::eByteOrderBig ? i : byte_size - i - 1;
+    *value = (*value << 8) | buf[byte];
+  }
+  return true;
+}
+
+
+int64_t LLV8::LoadPtr(int64_t addr, Error& err) {
+  uint64_t value;
+  if (!ReadUnsigned(addr, address_byte_size_, &value)) {
     // TODO(joyeecheung): use Error::Failure() to report information when
     // there is less noise from here.
-    err = Error(true, "Failed to load pointer from v8 memory");
+    err = Error(Error::kReadFailure,
+                "Failed to load pointer from v8 memory");
     return -1;
   }
 
@@ -82,14 +328,12 @@ int64_t LLV8::LoadPtr(int64_t addr, Error& err) {
 }
 
 int64_t LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size, Error& err) {
-  SBError sberr;
-  int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
-                                                  byte_size, sberr);
-
-  if (sberr.Fail()) {
+  uint64_t value;
+  if (!ReadUnsigned(addr, byte_size, &value)) {
     // TODO(joyeecheung): use Error::Failure() to report information when
     // there is less noise from here.
-    err = Error(true, "Failed to load unsigned from v8 memory");
+    err = Error(Error::kReadFailure,
+                "Failed to load unsigned from v8 memory");
     return -1;
   }
 
@@ -99,10 +343,8 @@ int64_t LLV8::LoadUnsigned(int64_t addr, uint32_t byte_size, Error& err) {
 
 
 double LLV8::LoadDouble(int64_t addr, Error& err) {
-  SBError sberr;
-  int64_t value = process_.ReadUnsignedFromMemory(static_cast<addr_t>(addr),
-                                                  sizeof(double), sberr);
-  if (sberr.Fail()) {
+  uint64_t value;
+  if (!ReadUnsigned(addr, sizeof(double), &value)) {
     err = Error::Failure(
         "Failed to load double from v8 memory, "
         "addr=0x%016" PRIx64,
@@ -121,9 +363,7 @@ double LLV8::LoadDouble(int64_t addr, Error& err) {
 
 std::string LLV8::LoadBytes(int64_t addr, int64_t length, Error& err) {
   uint8_t* buf = new uint8_t[length + 1];
-  SBError sberr;
-  process_.ReadMemory(addr, buf, static_cast<size_t>(length), sberr);
-  if (sberr.Fail()) {
+  if (!ReadMemory(addr, buf, length)) {
     err = Error::Failure(
         "Failed to load v8 backing store memory, "
         "addr=0x%016" PRIx64 ", length=%" PRId64,
@@ -148,25 +388,25 @@ std::string LLV8::LoadString(int64_t addr, int64_t length, Error& err) {
     return std::string();
   }
 
-  char* buf = new char[length + 1];
-  SBError sberr;
-  process_.ReadMemory(static_cast<addr_t>(addr), buf,
-                      static_cast<size_t>(length), sberr);
-  if (sberr.Fail()) {
+  // Read straight into the result, it's already UTF-8 when it's all ASCII.
+  std::string res(length, '\0');
+  if (length > 0 && !ReadMemory(addr, &res[0], length)) {
     err = Error::Failure(
         "Failed to load v8 one byte string memory, "
         "addr=0x%016" PRIx64 ", length=%" PRId64,
         addr, length);
-    delete[] buf;
     return std::string();
   }
 
-  buf[length] = '\0';
-
-  std::string res = buf;
-  delete[] buf;
   err = Error::Ok();
-  return res;
+  bool ascii = std::none_of(res.begin(), res.end(),
+                            [](char c) { return (c & 0x80) != 0; });
+  if (ascii) return res;
+
+  // One byte strings are Latin-1, two byte strings are output as UTF-8 too.
+  std::string utf8(length * kMaxUtf8BytesPerLatin1Char, '\0');
+  utf8.resize(Latin1ToUtf8(res.data(), length, &utf8[0]));
+  return utf8;
 }
 
 
@@ -176,24 +416,17 @@ std::string LLV8::LoadTwoByteString(int64_t addr, int64_t length, Error& err) {
     return std::string();
   }
 
-  char* buf = new char[length * 2 + 1];
-  SBError sberr;
-  process_.ReadMemory(static_cast<addr_t>(addr), buf,
-                      static_cast<size_t>(length * 2), sberr);
-  if (sberr.Fail()) {
+  std::unique_ptr<char[]> buf(new char[length * 2]);
+  if (length > 0 && !ReadMemory(addr, buf.get(), length * 2)) {
     err = Error::Failure(
         "Failed to load V8 two byte string memory, "
         "addr=0x%016" PRIx64 ", length=%" PRId64,
         addr, length);
-    delete[] buf;
     return std::string();
   }
 
-  for (int64_t i = 0; i < length; i++) buf[i] = buf[i * 2];
-  buf[length] = '\0';
-
-  std::string res = buf;
-  delete[] buf;
+  std::string res(length * kMaxUtf8BytesPerUtf16Unit, '\0');
+  if (length > 0) res.resize(Utf16ToUtf8(buf.get(), length, &res[0]));
   err = Error::Ok();
   return res;
 }
@@ -201,10 +434,7 @@ std::string LLV8::LoadTwoByteString(int64_t addr, int64_t length, Error& err) {
 
 uint8_t* LLV8::LoadChunk(int64_t addr, int64_t length, Error& err) {
   uint8_t* buf = new uint8_t[length];
-  SBError sberr;
-  process_.ReadMemory(static_cast<addr_t>(addr), buf,
-                      static_cast<size_t>(length), sberr);
-  if (sberr.Fail()) {
+  if (!ReadMemory(addr, buf, length)) {
     err = Error::Failure(
         "Failed to load V8 chunk memory, "
         "addr=0x%016" PRIx64 ", length=%" PRId64,
@@ -492,7 +722,7 @@ void Script::GetLineColumnFromPos(int64_t pos, int64_t& line, int64_t& column,
 
   // No source
   if (type > v8()->types()->kFirstNonstringType) {
-    err = Error(true, "No source");
+    err = Error(Error::kFailure, "No source");
     return;
   }
 
@@ -779,6 +1009,298 @@ std::string String::ToString(Error& err) {
 }
 
 
+std::string String::ToString(size_t limit, bool* truncated, Error& err) {
+  StringView view(*this, err);
+  if (err.Fail()) return std::string();
+  if (view.IsFlat()) return view.ToString(limit, truncated, err);
+
+  CheckedType<int64_t> repr = Representation(err);
+  RETURN_IF_INVALID(repr, std::string());
+  if (*repr == v8()->string()->kConsStringTag) {
+    ConsString cons(this);
+    return cons.ToString(limit, truncated, err);
+  }
+
+  std::string res = ToString(err);
+  *truncated = limit != 0 && res.size() > limit;
+  if (*truncated) res.resize(limit);
+  return res;
+}
+
+
+std::string ConsString::ToString(size_t limit, bool* truncated,
+                                 Error& err) {
+  *truncated = false;
+  CheckedType<int32_t> length = Length(err);
+  RETURN_IF_INVALID(length, std::string());
+
+  std::string res;
+  res.reserve(limit != 0 && limit < static_cast<size_t>(*length) ? limit
+                                                                  : *length);
+
+  // Every cons string holds at least one character, a core with more cons
+  // strings than characters in the rope has a cycle in it.
+  int64_t cons_left = *length;
+
+  // Leaves are appended left to right, the next one is on top of the stack.
+  std::vector<String> pending;
+  pending.push_back(*this);
+  while (!pending.empty()) {
+    String str = pending.back();
+    pending.pop_back();
+
+    if (limit != 0 && res.size() >= limit) {
+      CheckedType<int32_t> left = str.Length(err);
+      RETURN_IF_INVALID(left, std::string());
+      if (*left == 0) continue;
+      *truncated = true;
+      break;
+    }
+
+    CheckedType<int64_t> repr = str.Representation(err);
+    RETURN_IF_INVALID(repr, std::string());
+
+    if (*repr == v8()->string()->kConsStringTag) {
+      if (cons_left-- <= 0) {
+        err = Error::Failure("Malformed cons string 0x%016" PRIx64, raw());
+        return std::string();
+      }
+
+      ConsString cons(str);
+      String first = cons.First(err);
+      if (err.Fail()) return std::string();
+      String second = cons.Second(err);
+      if (err.Fail()) return std::string();
+
+      pending.push_back(second);
+      pending.push_back(first);
+      continue;
+    }
+
+    bool leaf_truncated;
+    size_t leaf_limit = limit != 0 ? limit - res.size() : 0;
+    std::string leaf = str.ToString(leaf_limit, &leaf_truncated, err);
+    if (err.Fail()) return std::string();
+    res += leaf;
+
+    if (leaf_truncated) {
+      *truncated = true;
+      break;
+    }
+  }
+
+  err = Error::Ok();
+  return res;
+}
+
+
+bool String::Equals(const std::string& other, Error& err) {
+  StringView view(*this, err);
+  if (err.Fail()) return false;
+  if (view.IsFlat()) return view.Equals(other, err);
+
+  std::string value = ToString(err);
+  return err.Success() && value == other;
+}
+
+
+bool String::StartsWith(const std::string& prefix, Error& err) {
+  StringView view(*this, err);
+  if (err.Fail()) return false;
+  if (view.IsFlat()) return view.StartsWith(prefix, err);
+
+  std::string value = ToString(err);
+  return err.Success() && value.compare(0, prefix.size(), prefix) == 0;
+}
+
+
+uint64_t String::Hash(Error& err) {
+  StringView view(*this, err);
+  if (err.Fail()) return 0;
+  if (view.IsFlat()) return view.Hash(err);
+
+  std::string value = ToString(err);
+  if (err.Fail()) return 0;
+  return StringView::Hash(value);
+}
+
+
+StringView::StringView(String str, Error& err)
+    : v8_(str.v8()), chars_(0), length_(0), two_byte_(false), flat_(false) {
+  // Sliced and thin strings can't point to each other, a couple of steps
+  // reach the string holding the characters.
+  static const int kMaxIndirections = 4;
+
+  CheckedType<int32_t> length = str.Length(err);
+  RETURN_IF_INVALID(length, );
+  if (*length < 0) return;
+  length_ = *length;
+
+  int64_t offset = 0;
+  for (int i = 0; i < kMaxIndirections; i++) {
+    CheckedType<int64_t> repr = str.Representation(err);
+    RETURN_IF_INVALID(repr, );
+
+    if (*repr == v8_->string()->kSeqStringTag) {
+      int64_t encoding = str.Encoding(err);
+      if (err.Fail()) return;
+      CheckedType<int32_t> seq_length = str.Length(err);
+      RETURN_IF_INVALID(seq_length, );
+      // Let ToString() report broken slices.
+      if (offset < 0 || offset + length_ > *seq_length) return;
+
+      if (encoding == v8_->string()->kOneByteStringTag) {
+        chars_ = str.LeaField(v8_->one_byte_string()->kCharsOffset) + offset;
+      } else if (encoding == v8_->string()->kTwoByteStringTag) {
+        two_byte_ = true;
+        chars_ =
+            str.LeaField(v8_->two_byte_string()->kCharsOffset) + offset * 2;
+      } else {
+        return;
+      }
+      flat_ = true;
+      return;
+    }
+
+    if (*repr == v8_->string()->kSlicedStringTag) {
+      SlicedString sliced(str);
+      Smi slice_offset = sliced.Offset(err);
+      if (err.Fail()) return;
+      offset += slice_offset.GetValue();
+      str = sliced.Parent(err);
+      if (err.Fail()) return;
+    } else if (*repr == v8_->string()->kThinStringTag) {
+      ThinString thin(str);
+      str = thin.Actual(err);
+      if (err.Fail()) return;
+    } else {
+      // Cons and external strings.
+      return;
+    }
+  }
+}
+
+
+template <class Callback>
+void StringView::Read(Callback callback, Error& err) const {
+  // Small enough to go through the memory cache.
+  static const int64_t kChunkLength = 512;
+  char raw[kChunkLength * 2];
+  char out[kChunkLength * kMaxUtf8BytesPerUtf16Unit];
+
+  int64_t char_size = two_byte_ ? 2 : 1;
+  for (int64_t done = 0; done < length_;) {
+    int64_t count = std::min(kChunkLength, length_ - done);
+    if (!v8_->ReadMemory(chars_ + done * char_size, raw, count * char_size)) {
+      err = Error(Error::kReadFailure, "Failed to load V8 string memory");
+      return;
+    }
+
+    // Keep surrogate pairs in one chunk.
+    if (two_byte_ && done + count < length_) {
+      uint16_t last;
+      memcpy(&last, raw + (count - 1) * 2, sizeof(last));
+      if (last >= 0xd800 && last <= 0xdbff) count--;
+    }
+    done += count;
+
+    size_t size = two_byte_ ? Utf16ToUtf8(raw, count, out)
+                            : Latin1ToUtf8(raw, count, out);
+    if (!callback(static_cast<const char*>(out), size)) break;
+  }
+  err = Error::Ok();
+}
+
+
+bool StringView::Equals(const std::string& other, Error& err) const {
+  size_t offset = 0;
+  bool equal = true;
+  Read(
+      [&](const char* data, size_t size) {
+        if (size > other.size() - offset ||
+            memcmp(data, other.data() + offset, size) != 0) {
+          equal = false;
+          return false;
+        }
+        offset += size;
+        return true;
+      },
+      err);
+  return err.Success() && equal && offset == other.size();
+}
+
+
+bool StringView::StartsWith(const std::string& prefix, Error& err) const {
+  size_t offset = 0;
+  bool match = true;
+  Read(
+      [&](const char* data, size_t size) {
+        size_t count = std::min(size, prefix.size() - offset);
+        if (memcmp(data, prefix.data() + offset, count) != 0) {
+          match = false;
+          return false;
+        }
+        offset += count;
+        return offset < prefix.size();
+      },
+      err);
+  return err.Success() && match && offset == prefix.size();
+}
+
+
+// FNV-1a
+static inline uint64_t HashStringBytes(uint64_t hash, const char* data,
+                                       size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static const uint64_t kStringHashSeed = 0xcbf29ce484222325ULL;
+
+
+uint64_t StringView::Hash(Error& err) const {
+  uint64_t hash = kStringHashSeed;
+  Read(
+      [&](const char* data, size_t size) {
+        hash = HashStringBytes(hash, data, size);
+        return true;
+      },
+      err);
+  return hash;
+}
+
+
+uint64_t StringView::Hash(const std::string& str) {
+  return HashStringBytes(kStringHashSeed, str.data(), str.size());
+}
+
+
+std::string StringView::ToString(size_t limit, bool* truncated,
+                                 Error& err) const {
+  std::string res;
+  *truncated = false;
+  Read(
+      [&](const char* data, size_t size) {
+        if (limit != 0 && res.size() + size > limit) {
+          size_t left = limit - res.size();
+          // Don't cut UTF-8 sequences in half.
+          while (left > 0 && (data[left] & 0xc0) == 0x80) left--;
+          res.append(data, left);
+          *truncated = true;
+          return false;
+        }
+        res.append(data, size);
+        return true;
+      },
+      err);
+  if (err.Fail()) return std::string();
+  return res;
+}
+
+
 // Context locals iterator implementations
 Context::Locals::Locals(Context* context, Error& err) {
   context_ = context;
@@ -881,6 +1403,11 @@ std::vector<std::pair<Value, Value>> JSObject::Entries(Error& err) {
 
 
 std::vector<std::pair<Value, Value>> JSObject::DictionaryEntries(Error& err) {
+  int64_t type = GetType(err);
+  if (err.Fail()) return {};
+  if (type == v8()->types()->kGlobalObjectType)
+    return GlobalDictionaryEntries(err);
+
   HeapObject dictionary_obj = Properties(err);
   if (err.Fail()) return {};
 
@@ -908,6 +1435,48 @@ std::vector<std::pair<Value, Value>> JSObject::DictionaryEntries(Error& err) {
 }
 
 
+std::vector<std::pair<Value, Value>> JSObject::GlobalDictionaryEntries(
+    Error& err) {
+  HeapObject dictionary_obj = Properties(err);
+  if (err.Fail()) return {};
+
+  GlobalDictionary dictionary(dictionary_obj);
+
+  int64_t length = dictionary.Length(err);
+  if (err.Fail()) return {};
+
+  int64_t cell_type = v8()->types()->kPropertyCellType;
+  std::vector<std::pair<Value, Value>> entries;
+  for (int64_t i = 0; i < length; i++) {
+    HeapObject cell_obj = dictionary.GetCell(i, err);
+    if (err.Fail()) return entries;
+
+    // Skip holes
+    bool is_hole = cell_obj.IsHoleOrUndefined(err);
+    if (err.Fail()) return entries;
+    if (is_hole || !cell_obj.Check()) continue;
+
+    int64_t type = cell_obj.GetType(err);
+    if (err.Fail()) return entries;
+    if (cell_type != -1 && type != cell_type) continue;
+
+    PropertyCell cell(cell_obj);
+    Value key = cell.Name(err);
+    if (err.Fail()) return entries;
+    Value value = cell.CellValue(err);
+    if (err.Fail()) return entries;
+
+    // Deleted properties leave the hole in their cell.
+    is_hole = value.IsHole(err);
+    if (err.Fail()) return entries;
+    if (is_hole) continue;
+
+    entries.push_back(std::pair<Value, Value>(key, value));
+  }
+  return entries;
+}
+
+
 std::vector<std::pair<Value, Value>> JSObject::DescriptorEntries(Map map,
                                                                  Error& err) {
   HeapObject descriptors_obj = map.InstanceDescriptors(err);
@@ -1000,6 +1569,17 @@ void JSObject::ElementKeys(std::vector<std::string>& keys, Error& err) {
 }
 
 void JSObject::DictionaryKeys(std::vector<std::string>& keys, Error& err) {
+  int64_t type = GetType(err);
+  if (err.Fail()) return;
+  if (type == v8()->types()->kGlobalObjectType) {
+    for (auto& entry : GlobalDictionaryEntries(err)) {
+      std::string key_name = entry.first.ToString(err);
+      if (err.Fail()) return;
+      keys.push_back(key_name);
+    }
+    return;
+  }
+
   HeapObject dictionary_obj = Properties(err);
   if (err.Fail()) return;
 
@@ -1090,6 +1670,16 @@ Value JSObject::GetProperty(std::string key_name, Error& err) {
 }
 
 Value JSObject::GetDictionaryProperty(std::string key_name, Error& err) {
+  int64_t type = GetType(err);
+  if (err.Fail()) return Value();
+  if (type == v8()->types()->kGlobalObjectType) {
+    for (auto& entry : GlobalDictionaryEntries(err)) {
+      if (entry.first.ToString(err) == key_name) return entry.second;
+      if (err.Fail()) return Value();
+    }
+    return Value();
+  }
+
   HeapObject dictionary_obj = Properties(err);
   if (err.Fail()) return Value();
 
@@ -1,11 +1,16 @@
 #ifndef SRC_LLV8_H_
 #define SRC_LLV8_H_
 
+#include <atomic>
 #include <cstring>
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include <lldb/API/LLDB.h>
 
+#include "src/core-file.h"
 #include "src/error.h"
 #include "src/llv8-constants.h"
 
@@ -20,7 +25,10 @@ class Environment;
 class Printer;
 class FindJSObjectsVisitor;
 class FindReferencesCmd;
+class FindRootsCmd;
 class FindObjectsCmd;
+class LLScan;
+class PointerPrefilter;
 
 namespace v8 {
 
@@ -28,6 +36,10 @@ namespace v8 {
 class LLV8;
 class CodeMap;
 
+namespace layouts {
+struct Dynamic;
+}
+
 
 #define V8_VALUE_DEFAULT_METHODS(NAME, PARENT)     \
   NAME(const NAME& v) = default;                   \
@@ -115,12 +127,17 @@ class HeapObject : public Value {
  public:
   V8_VALUE_DEFAULT_METHODS(HeapObject, Value)
 
+  // Returns the tagged pointer to an object stored at `address`.
+  static inline HeapObject FromAddress(LLV8* v8, int64_t address);
+
   inline bool Check() const;
   inline int64_t LeaField(int64_t off) const;
   inline int64_t LoadField(int64_t off, Error& err);
 
   template <class T>
-  inline CheckedType<T> LoadCheckedField(Constant<int64_t> off);
+  inline CheckedType<T> LoadCheckedField(int64_t off);
+  template <class T>
+  inline CheckedType<T> LoadCheckedField(const Constant<int64_t>& off);
 
   template <class T>
   inline T LoadFieldValue(int64_t off, Error& err);
@@ -172,6 +189,15 @@ class String : public HeapObject {
   inline CheckedType<int32_t> Length(Error& err);
 
   std::string ToString(Error& err);
+  // ToString() cut after `limit` bytes, 0 means no limit. `truncated` is set
+  // when something was left out.
+  std::string ToString(size_t limit, bool* truncated, Error& err);
+
+  // Same as comparing or hashing ToString(), without building it for strings
+  // StringView can read in place.
+  bool Equals(const std::string& other, Error& err);
+  bool StartsWith(const std::string& prefix, Error& err);
+  uint64_t Hash(Error& err);
 
   static inline bool IsString(LLV8* v8, HeapObject heap_object, Error& err);
 };
@@ -256,6 +282,9 @@ class ConsString : public String {
   inline String Second(Error& err);
 
   inline std::string ToString(Error& err);
+  // Walks the rope iteratively, so deeply nested cons strings are fine, and
+  // stops reading once `limit` bytes are produced (0 means no limit).
+  std::string ToString(size_t limit, bool* truncated, Error& err);
 };
 
 class SlicedString : public String {
@@ -277,6 +306,41 @@ class ThinString : public String {
   inline std::string ToString(Error& err);
 };
 
+// The characters of a string which is stored in one piece in the target
+// (a sequential string, or a sliced or thin string over one), read a chunk at a
+// time through LLV8::ReadMemory. Strings can be compared, hashed and
+// prefix-matched without materializing them. Chunks hold the same UTF-8
+// bytes String::ToString() would return. Other strings aren't flat, and
+// callers use ToString() for them.
+class StringView {
+ public:
+  StringView(String str, Error& err);
+
+  inline bool IsFlat() const { return flat_; }
+  // In characters.
+  inline int64_t length() const { return length_; }
+
+  bool Equals(const std::string& other, Error& err) const;
+  bool StartsWith(const std::string& prefix, Error& err) const;
+  uint64_t Hash(Error& err) const;
+  std::string ToString(size_t limit, bool* truncated, Error& err) const;
+
+  // Hash() of a string which was already materialized.
+  static uint64_t Hash(const std::string& str);
+
+ private:
+  // Calls `callback(const char* data, size_t size)` with the output in order
+  // until it returns false.
+  template <class Callback>
+  void Read(Callback callback, Error& err) const;
+
+  LLV8* v8_;
+  int64_t chars_;
+  int64_t length_;
+  bool two_byte_;
+  bool flat_;
+};
+
 class HeapNumber : public HeapObject {
  public:
   V8_VALUE_DEFAULT_METHODS(HeapNumber, HeapObject)
@@ -317,6 +381,7 @@ class JSObject : public HeapObject {
   void DictionaryKeys(std::vector<std::string>& keys, Error& err);
   void DescriptorKeys(std::vector<std::string>& keys, Map map, Error& err);
   std::vector<std::pair<Value, Value>> DictionaryEntries(Error& err);
+  std::vector<std::pair<Value, Value>> GlobalDictionaryEntries(Error& err);
   std::vector<std::pair<Value, Value>> DescriptorEntries(Map map, Error& err);
   Value GetDictionaryProperty(std::string key_name, Error& err);
   Value GetDescriptorProperty(std::string key_name, Map map, Error& err);
@@ -485,6 +550,24 @@ class NameDictionary : public FixedArray {
   inline int64_t Length(Error& err);
 };
 
+// Properties of global objects. Entries are PropertyCells, which hold the
+// name as well as the value.
+class GlobalDictionary : public FixedArray {
+ public:
+  V8_VALUE_DEFAULT_METHODS(GlobalDictionary, FixedArray)
+
+  inline HeapObject GetCell(int index, Error& err);
+  inline int64_t Length(Error& err);
+};
+
+class PropertyCell : public HeapObject {
+ public:
+  V8_VALUE_DEFAULT_METHODS(PropertyCell, HeapObject)
+
+  inline Value Name(Error& err);
+  inline Value CellValue(Error& err);
+};
+
 class ScopeInfo : public FixedArray {
  public:
   V8_VALUE_DEFAULT_METHODS(ScopeInfo, FixedArray)
@@ -626,12 +709,92 @@ class JSFrame : public Value {
   friend class llnode::Printer;
 };
 
+// LRU cache of aligned blocks of process memory. LLV8 serves its loads from it
+// so that reading the fields of an object, or of neighbouring objects, costs a
+// single lldb call. Scan workers share it, blocks are spread over shards with
+// their own lock so that they rarely wait on each other.
+class MemoryCache {
+ public:
+  static const uint64_t kBlockSize = 4096;
+  // Bigger reads go straight to lldb, they would only push useful blocks out.
+  static const uint64_t kMaxCachedRead = 16 * kBlockSize;
+  static const uint64_t kShardCount = 16;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Reads which bypassed the cache.
+    uint64_t uncached = 0;
+  };
+
+  MemoryCache() : stop_id_(0), max_blocks_(0), uncached_(0) {}
+
+  // Called before every command, not while reads are in flight. Drops every
+  // block when switching to another process or once the process ran, and
+  // applies the `memory-cache-size` setting.
+  void SetProcess(lldb::SBProcess process);
+  // Copies `size` bytes at `addr` to `buf`. Returns false if they can't all
+  // be read.
+  bool Read(uint64_t addr, void* buf, uint64_t size);
+  Stats GetStats();
+
+ private:
+  struct Block {
+    uint64_t address;
+    uint8_t data[kBlockSize];
+  };
+  // Most recently used first.
+  typedef std::list<Block> BlockList;
+
+  struct Shard {
+    std::mutex mutex;
+    BlockList blocks;
+    std::unordered_map<uint64_t, BlockList::iterator> index;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  inline Shard& GetShard(uint64_t block_address) {
+    return shards_[(block_address / kBlockSize) % kShardCount];
+  }
+  // Copies `length` bytes at `offset` in the block at `block_address`,
+  // loading the block if it isn't cached. lldb is never called with a shard
+  // locked.
+  bool ReadBlock(uint64_t block_address, uint64_t offset, uint8_t* out,
+                 uint64_t length);
+  bool ReadUncached(uint64_t addr, void* buf, uint64_t size);
+
+  lldb::SBProcess process_;
+  // Memory of a live process may change whenever it runs.
+  uint32_t stop_id_;
+  // Per shard.
+  uint64_t max_blocks_;
+  Shard shards_[kShardCount];
+  std::atomic<uint64_t> uncached_;
+};
+
 class LLV8 {
  public:
-  LLV8() : target_(lldb::SBTarget()) {}
+  LLV8()
+      : target_(lldb::SBTarget()),
+        address_byte_size_(8),
+        byte_order_(lldb::eByteOrderLittle) {}
 
   void Load(lldb::SBTarget target);
 
+  // Constants are loaded lazily on first use. Load all of them upfront before
+  // sharing this instance between threads.
+  void LoadAllConstants();
+
+  inline MemoryCache::Stats GetMemoryCacheStats() {
+    return memory_cache_.GetStats();
+  }
+
+  // File the core was loaded from, the `core-file` setting is used when it's
+  // not set. Cores mapped from it are read without going through lldb.
+  inline void SetCoreFile(const std::string& path) { core_path_ = path; }
+  std::string GetCoreFile();
+
  private:
   template <class T>
   inline T LoadValue(int64_t addr, Error& err);
@@ -649,9 +812,23 @@ class LLV8 {
   std::string LoadString(int64_t addr, int64_t length, Error& err);
   std::string LoadTwoByteString(int64_t addr, int64_t length, Error& err);
   uint8_t* LoadChunk(int64_t addr, int64_t length, Error& err);
+  void LoadCoreFile();
+  // Copies process memory from the mapped core if possible, from lldb
+  // otherwise.
+  bool ReadMemory(uint64_t addr, void* buf, uint64_t size);
+  // Reads an unsigned integer of `byte_size` bytes in the target byte order.
+  bool ReadUnsigned(int64_t addr, uint32_t byte_size, uint64_t* value);
 
   lldb::SBTarget target_;
   lldb::SBProcess process_;
+  uint32_t address_byte_size_;
+  lldb::ByteOrder byte_order_;
+  MemoryCache memory_cache_;
+  std::string core_path_;
+  CoreFile core_file_;
+  // What LoadCoreFile() last tried to map, whether it succeeded or not.
+  std::string core_file_tried_;
+  lldb::SBProcess core_file_process_;
 
   constants::Common common;
   constants::Smi smi;
@@ -684,6 +861,7 @@ class LLV8 {
   constants::JSDate js_date;
   constants::DescriptorArray descriptor_array;
   constants::NameDictionary name_dictionary;
+  constants::PropertyCell property_cell;
   constants::Frame frame;
   constants::Symbol symbol;
   constants::Types types;
@@ -704,6 +882,7 @@ class LLV8 {
   friend class ConsString;
   friend class SlicedString;
   friend class ThinString;
+  friend class StringView;
   friend class HeapNumber;
   friend class JSObject;
   friend class JSError;
@@ -714,6 +893,8 @@ class LLV8 {
   friend class JSTypedArray;
   friend class DescriptorArray;
   friend class NameDictionary;
+  friend class GlobalDictionary;
+  friend class PropertyCell;
   friend class Context;
   friend class ScopeInfo;
   friend class Oddball;
@@ -723,10 +904,14 @@ class LLV8 {
   friend class JSDate;
   friend class CodeMap;
   friend class Symbol;
+  friend struct layouts::Dynamic;
   friend class llnode::Printer;
   friend class llnode::FindJSObjectsVisitor;
   friend class llnode::FindObjectsCmd;
   friend class llnode::FindReferencesCmd;
+  friend class llnode::FindRootsCmd;
+  friend class llnode::LLScan;
+  friend class llnode::PointerPrefilter;
   friend class llnode::node::constants::Environment;
 };
 
@@ -64,6 +64,7 @@ void Node::Load(SBTarget target) {
   if (target_ == target) return;
 
   target_ = target;
+  ConstantCache::Open(target);
 
   env.Assign(target);
   req_wrap_queue.Assign(target);
@@ -161,12 +161,12 @@ std::string Printer::Stringify(v8::HeapNumber heap_number, Error& err) {
 
 template <>
 std::string Printer::Stringify(v8::String str, Error& err) {
-  std::string val = str.ToString(err);
+  // Only the part which is shown is read.
+  bool truncated;
+  std::string val = str.ToString(options_.length, &truncated, err);
   if (err.Fail()) return std::string();
 
-  unsigned int len = options_.length;
-
-  if (len != 0 && val.length() > len) val = val.substr(0, len) + "...";
+  if (truncated) val += "...";
 
   std::stringstream ss;
   ss << rang::fg::yellow << "<String: \"" + val + "\">" << rang::fg::reset;
@@ -922,12 +922,10 @@ std::string Printer::StringifyElements(v8::JSObject js_object, int64_t length,
 }
 
 std::string Printer::StringifyDictionary(v8::JSObject js_object, Error& err) {
-  v8::HeapObject dictionary_obj = js_object.Properties(err);
-  if (err.Fail()) return std::string();
-
-  v8::NameDictionary dictionary(dictionary_obj);
-
-  int64_t length = dictionary.Length(err);
+  // Global objects keep their properties in PropertyCells, DictionaryEntries()
+  // reads either kind of dictionary.
+  std::vector<std::pair<v8::Value, v8::Value>> entries =
+      js_object.DictionaryEntries(err);
   if (err.Fail()) return std::string();
 
   Printer printer(llv8_);
@@ -935,17 +933,9 @@ std::string Printer::StringifyDictionary(v8::JSObject js_object, Error& err) {
   std::string res;
   std::stringstream ss;
 
-  for (int64_t i = 0; i < length; i++) {
-    v8::Value key = dictionary.GetKey(i, err);
-    if (err.Fail()) return std::string();
-
-    // Skip holes
-    bool is_hole = key.IsHoleOrUndefined(err);
-    if (err.Fail()) return std::string();
-    if (is_hole) continue;
-
-    v8::Value value = dictionary.GetValue(i, err);
-    if (err.Fail()) return std::string();
+  for (auto& entry : entries) {
+    v8::Value key = entry.first;
+    v8::Value value = entry.second;
 
     if (!res.empty()) res += ",\n";
 
@@ -27,6 +27,58 @@ int Settings::SetTreePadding(int option) {
   return tree_padding;
 }
 
+int Settings::SetScanThreads(int option) {
+  // 0 means "one thread per available core".
+  if (option < 0) option = 1;
+  scan_threads = option;
+  return scan_threads;
+}
+
+int Settings::SetScanReadAhead(int option) {
+  // 0 disables the reader thread.
+  if (option < 0) option = 0;
+  scan_read_ahead = option;
+  return scan_read_ahead;
+}
+
+std::string Settings::SetScanMode(std::string option) {
+  if (option == "pointers" || option == "objects" || option == "two-pass")
+    scan_mode = option;
+  return scan_mode;
+}
+
+std::string Settings::SetScanLayout(std::string option) {
+  if (option == "auto" || option == "dynamic") scan_layout = option;
+  return scan_layout;
+}
+
+bool Settings::SetCompressInstances(bool option) {
+  compress_instances = option;
+  return compress_instances;
+}
+
+std::string Settings::SetHeapIndex(std::string option) {
+  if (!option.empty()) heap_index = option;
+  return heap_index;
+}
+
+std::string Settings::SetConstantsCache(std::string option) {
+  if (!option.empty()) constants_cache = option;
+  return constants_cache;
+}
+
+int Settings::SetMemoryCacheSize(int option) {
+  // 0 disables the cache.
+  if (option < 0) option = 0;
+  memory_cache_size = option;
+  return memory_cache_size;
+}
+
+std::string Settings::SetCoreFile(std::string option) {
+  core_file = option == "none" ? "" : option;
+  return core_file;
+}
+
 bool Settings::ShouldUseColor() {
 #ifdef NO_COLOR_OUTPUT
   return false;
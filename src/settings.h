@@ -21,6 +21,15 @@ class Settings {
 
   std::string color = "auto";
   int tree_padding = 2;
+  int scan_threads = 1;
+  int scan_read_ahead = 2;
+  std::string scan_layout = "auto";
+  std::string scan_mode = "pointers";
+  bool compress_instances = false;
+  std::string heap_index = "auto";
+  std::string constants_cache = "auto";
+  int memory_cache_size = 16;
+  std::string core_file = "";
 
 
  public:
@@ -30,6 +39,24 @@ class Settings {
   bool ShouldUseColor();
   int GetTreePadding() { return tree_padding; };
   int SetTreePadding(int option);
+  int GetScanThreads() { return scan_threads; };
+  int SetScanThreads(int option);
+  int GetScanReadAhead() { return scan_read_ahead; };
+  int SetScanReadAhead(int option);
+  std::string GetScanLayout() { return scan_layout; };
+  std::string SetScanLayout(std::string option);
+  std::string GetScanMode() { return scan_mode; };
+  std::string SetScanMode(std::string option);
+  bool GetCompressInstances() { return compress_instances; };
+  bool SetCompressInstances(bool option);
+  std::string GetHeapIndex() { return heap_index; };
+  std::string SetHeapIndex(std::string option);
+  std::string GetConstantsCache() { return constants_cache; };
+  std::string SetConstantsCache(std::string option);
+  int GetMemoryCacheSize() { return memory_cache_size; };
+  int SetMemoryCacheSize(int option);
+  std::string GetCoreFile() { return core_file; };
+  std::string SetCoreFile(std::string option);
 };
 
 }  // namespace llnode
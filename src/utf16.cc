@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LLNODE_UTF16_SSE2 1
+#endif
+
+#include "src/utf16.h"
+
+namespace llnode {
+
+namespace {
+
+inline uint32_t LoadUnit(const char* in, size_t index) {
+  uint16_t unit;
+  memcpy(&unit, in + index * 2, sizeof(unit));
+  return unit;
+}
+
+// Writes the character starting at unit `index` to `out` and returns the
+// index of the next one.
+inline size_t ConvertChar(const char* in, size_t index, size_t length,
+                          char*& out) {
+  uint32_t c = LoadUnit(in, index++);
+  if (c < 0x80) {
+    *out++ = static_cast<char>(c);
+    return index;
+  }
+  if (c < 0x800) {
+    *out++ = static_cast<char>(0xc0 | (c >> 6));
+    *out++ = static_cast<char>(0x80 | (c & 0x3f));
+    return index;
+  }
+
+  if (c >= 0xd800 && c <= 0xdfff) {
+    uint32_t low = index < length ? LoadUnit(in, index) : 0;
+    if (c <= 0xdbff && low >= 0xdc00 && low <= 0xdfff) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+      *out++ = static_cast<char>(0xf0 | (c >> 18));
+      *out++ = static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      *out++ = static_cast<char>(0x80 | (c & 0x3f));
+      return index + 1;
+    }
+    c = 0xfffd;
+  }
+
+  *out++ = static_cast<char>(0xe0 | (c >> 12));
+  *out++ = static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+  *out++ = static_cast<char>(0x80 | (c & 0x3f));
+  return index;
+}
+
+}  // namespace
+
+
+size_t Utf16ToUtf8Scalar(const char* in, size_t length, char* out) {
+  char* start = out;
+  size_t i = 0;
+  while (i < length) i = ConvertChar(in, i, length, out);
+  return out - start;
+}
+
+
+size_t Utf16ToUtf8(const char* in, size_t length, char* out) {
+#ifdef LLNODE_UTF16_SSE2
+  // Most strings in a heap are mostly ASCII, 16 units at a time are checked
+  // and narrowed to bytes, blocks with anything else go through
+  // ConvertChar().
+  static const size_t kBlock = 16;
+  const __m128i non_ascii = _mm_set1_epi16(static_cast<int16_t>(0xff80));
+  const __m128i zero = _mm_setzero_si128();
+
+  char* start = out;
+  size_t i = 0;
+  while (length - i >= kBlock) {
+    __m128i low =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+    __m128i high =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2 + 16));
+    __m128i bits = _mm_and_si128(_mm_or_si128(low, high), non_ascii);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) == 0xffff) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                       _mm_packus_epi16(low, high));
+      out += kBlock;
+      i += kBlock;
+      continue;
+    }
+
+    // A surrogate pair may end one unit past the block.
+    size_t end = i + kBlock;
+    while (i < end) i = ConvertChar(in, i, length, out);
+  }
+  while (i < length) i = ConvertChar(in, i, length, out);
+  return out - start;
+#else
+  return Utf16ToUtf8Scalar(in, length, out);
+#endif
+}
+
+
+
+size_t Latin1ToUtf8(const char* in, size_t length, char* out) {
+  char* start = out;
+  size_t i = 0;
+  while (i < length) {
+    // Copy runs of ASCII 8 bytes at a time.
+    uint64_t block;
+    if (length - i >= sizeof(block)) {
+      memcpy(&block, in + i, sizeof(block));
+      if ((block & 0x8080808080808080ULL) == 0) {
+        memcpy(out, &block, sizeof(block));
+        out += sizeof(block);
+        i += sizeof(block);
+        continue;
+      }
+    }
+
+    uint8_t c = static_cast<uint8_t>(in[i++]);
+    if (c < 0x80) {
+      *out++ = static_cast<char>(c);
+    } else {
+      *out++ = static_cast<char>(0xc0 | (c >> 6));
+      *out++ = static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+  return out - start;
+}
+
+}  // namespace llnode
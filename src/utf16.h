@@ -0,0 +1,32 @@
+#ifndef SRC_UTF16_H_
+#define SRC_UTF16_H_
+
+#include <stddef.h>
+
+namespace llnode {
+
+// A UTF-16 code unit never takes more than 3 bytes of UTF-8, surrogate pairs
+// take 4 bytes for 2 units.
+const size_t kMaxUtf8BytesPerUtf16Unit = 3;
+
+// Transcodes `length` UTF-16 code units in host byte order at `in` to UTF-8
+// and returns how many bytes were written to `out`, which must have room for
+// `length * kMaxUtf8BytesPerUtf16Unit` bytes. `in` doesn't need to be aligned.
+// Unpaired surrogates are written as U+FFFD.
+size_t Utf16ToUtf8(const char* in, size_t length, char* out);
+
+// Same as Utf16ToUtf8() one code unit at a time, used where SSE2 isn't
+// available.
+size_t Utf16ToUtf8Scalar(const char* in, size_t length, char* out);
+
+// A Latin-1 character never takes more than 2 bytes of UTF-8.
+const size_t kMaxUtf8BytesPerLatin1Char = 2;
+
+// Transcodes `length` Latin-1 characters at `in`, which is how V8 stores one
+// byte strings, to UTF-8 and returns how many bytes were written to `out`. It
+// must have room for `length * kMaxUtf8BytesPerLatin1Char` bytes.
+size_t Latin1ToUtf8(const char* in, size_t length, char* out);
+
+}  // namespace llnode
+
+#endif  // SRC_UTF16_H_
@@ -67,6 +67,8 @@ function SessionOutput(session, stream, timeout) {
     }
   }
 
+  // Don't split UTF-8 sequences across chunks.
+  stream.setEncoding('utf8');
   stream.on('data', (data) => {
     buf += data;
     this.flush();
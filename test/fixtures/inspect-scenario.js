@@ -41,6 +41,10 @@ function closure() {
   c.hashmap['internalized-string'] = 'foobar';
   // This thin string points to the previous 'foobar'.
   c.hashmap['thin-string'] = makeThin('foo', 'bar');
+  // V8 keeps this one as Latin-1 in a one byte string.
+  c.hashmap['latin1-string'] = 'Grüße';
+  // Characters outside Latin-1, and a surrogate pair, need a two byte string.
+  c.hashmap['utf16-string'] = 'Grüße 世界 \u{1F600}';
   // Create an externalized string and slice it.
   c.hashmap['externalized-string'] =
       'string that will be externalized and sliced';
@@ -56,6 +56,18 @@ function closure() {
 
   let classC = new Class_C(arr);
 
+  // Only held by a property of the global object.
+  function Class_D() {
+    this.my_class_d = "Class D";
+  }
+  global.my_class_d = new Class_D();
+
+  // Held by the global object through two other objects.
+  function Class_E() {
+    this.my_class_e = "Class E";
+  }
+  global.my_class_e_holder = { outer: { inner: new Class_E() } };
+
   c.method();
 }
 
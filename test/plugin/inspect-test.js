@@ -121,6 +121,28 @@ const hashMapTests = {
       });
     }
   },
+  // .latin1-string=0x000036eccf7bda91:<String: "Grüße">,
+  'latin1-string': {
+    re: /.latin1-string=(0x[0-9a-f]+):<String: "Grüße">/,
+    desc: '.latin1-string one byte string property'
+  },
+  // .utf16-string=0x000036eccf7bdaa9:<String: "Grüße 世界 ...">,
+  'utf16-string': {
+    re: /.utf16-string=(0x[0-9a-f]+):<String: "Grüße 世界 \.\.\.">/,
+    desc: '.utf16-string two byte string property',
+    validator(t, sess, addresses, name, cb) {
+      const address = addresses[name];
+      sess.send(`v8 inspect -F ${address}`);
+
+      sess.linesUntil(/">/, (err, lines) => {
+        if (err) return cb(err);
+        lines = lines.join('\n');
+        t.ok(lines.includes('<String: "Grüße 世界 \u{1F600}">'),
+            'hashmap.utf16-string should have the right content');
+        cb(null);
+      });
+    }
+  },
   // .externalized-string=0x000036eccf7bdb41:<String: "(external)">,
   'externalized-string': {
     re: /.externalized-string=(0x[0-9a-f]+):<String: "\(external\)">/,
@@ -1,5 +1,8 @@
 'use strict';
 
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
 const tape = require('tape');
 const common = require('../common');
 const versionMark = common.versionMark;
@@ -34,6 +37,71 @@ function testFindrefsForInvalidExpr(t, sess, next) {
   });
 }
 
+// Lines of `v8 findjsobjects` for the classes of scan-scenario.js.
+function classCounts(lines) {
+  return lines.map((line) => line.trim())
+              .filter((line) => /^\d+ +\d+ Class(_B|_C)?$/.test(line))
+              .sort();
+}
+
+// Indexes are replaced through a rename, a new inode means a new index.
+function indexInode(index) {
+  return fs.existsSync(index) ? fs.statSync(index).ino : null;
+}
+
+// Saves scan results to a heap index, checks they're rescanned when the scan
+// mode changes and reused by the next session. Ends the test.
+function testHeapIndex(t, sess, executable, core, pointerCounts) {
+  const index = path.join(os.tmpdir(), 'llnode-scan-test.index');
+  if (fs.existsSync(index)) fs.unlinkSync(index);
+
+  sess.send(`v8 settings set heap-index ${index}`);
+  sess.send('v8 settings set scan-mode two-pass');
+  sess.send('v8 findjsobjects');
+  sess.send('version');
+
+  let inode;
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'scan saved to the heap index should find the same objects');
+    inode = indexInode(index);
+    t.ok(inode !== null, 'heap index should be saved');
+
+    sess.send('v8 settings set scan-mode pointers');
+    sess.send('v8 findjsobjects');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'scan after a mode change should find the same objects');
+    t.notEqual(indexInode(index), inode,
+               'heap index of another scan mode should be replaced');
+    inode = indexInode(index);
+    sess.quit();
+
+    const next = common.Session.loadCore(executable, core, (err) => {
+      t.error(err);
+      next.send(`v8 settings set heap-index ${index}`);
+      next.send('v8 findjsobjects');
+      next.send('version');
+    });
+
+    next.linesUntil(versionMark, (err, lines) => {
+      t.error(err);
+      t.deepEqual(classCounts(lines), pointerCounts,
+                  'results loaded from the heap index should be the same');
+      t.equal(indexInode(index), inode,
+              'heap index should be reused by the next session');
+      fs.unlinkSync(index);
+      next.quit();
+      t.end();
+    });
+  });
+}
+
 function test(executable, core, t) {
   const sess = common.Session.loadCore(executable, core, (err) => {
     t.error(err);
@@ -44,15 +112,111 @@ function test(executable, core, t) {
     sess.send('version');
   });
 
+  let pointerCounts;
   sess.linesUntil(versionMark, (err, lines) => {
     t.error(err);
     t.ok(/\d+ Class/.test(lines.join('\n')), 'Class should be in findjsobjects');
+    pointerCounts = classCounts(lines);
 
-    sess.send('v8 findjsobjects -d');
-    // Just a separator
+    // Changing the scan mode throws away the previous results
+    sess.send('v8 settings set scan-mode two-pass');
+    sess.send('v8 findjsobjects -j 2');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'two-pass scan should find the same objects');
+
+    sess.send('v8 settings set scan-mode objects');
+    sess.send('v8 findjsobjects');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'object scan should find the same objects');
+
+    sess.send('v8 settings set scan-mode pointers');
+    sess.send('v8 findjsobjects -j 2');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'scan on two threads should find the same objects');
+
+    // The mode change makes the next scan store compressed instances
+    sess.send('v8 settings set compress-instances on');
+    sess.send('v8 settings set scan-mode objects');
+    sess.send('v8 findjsobjects');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'scan with compressed instances should find the same objects');
+
+    sess.send('v8 findjsinstances -n 5 Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok((lines.join('\n').match(/<Object: Class_B>/g)).length == 5,
+         'Should show 5 compressed instances');
+    t.ok(/\(Showing 1 to 5 of 10 instances\)/.test(lines.join('\n')),
+         'Should show 1 to 5 compressed instances');
+
+    sess.send('v8 findjsinstances -n 5 Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok((lines.join('\n').match(/<Object: Class_B>/g)).length == 5,
+         'Should show the next 5 compressed instances');
+    t.ok(/\(Showing 6 to 10 of 10 instances\)/.test(lines.join('\n')),
+         'Should show 6 to 10 compressed instances');
+
+    sess.send('v8 settings set compress-instances off');
+    // Memory is read straight from the core file from now on
+    sess.send(`v8 settings set core-file ${core}`);
+    sess.send('v8 settings set scan-mode pointers');
+    sess.send('v8 findjsobjects');
     sess.send('version');
   });
 
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.deepEqual(classCounts(lines), pointerCounts,
+                'scan of the mapped core file should find the same objects');
+
+    sess.send('v8 findjsinstances Class_B');
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok((lines.join('\n').match(/<Object: Class_B>/g)).length == 10,
+         'Should show 10 instances from the mapped core file');
+
+    sess.waitError(/error:/, (err, line) => {
+      t.error(err);
+      t.ok(/Invalid number of jobs/.test(line),
+           'non-numeric --jobs should be rejected');
+
+      sess.send('v8 findjsobjects -d');
+      // Just a separator
+      sess.send('version');
+    });
+    sess.send('v8 findjsobjects -j abc');
+  });
+
   sess.linesUntil(versionMark, (err, lines) => {
     t.error(err);
     t.ok(/3 +0 Class: x, y, hashmap/.test(lines.join('\n')),
@@ -96,13 +260,15 @@ function test(executable, core, t) {
   });
 
   // Test for recursive findrefs, a new `Class_C` was introduced in `inspect-scenario.js`
+  let classB;
   sess.linesUntil(versionMark, (err, lines) => {
     t.error(err);
 
     for (let i=0; i < lines.length; i++) {
       const match = lines[i].match(/(0x[0-9a-f]+):<Object: Class_B>/i);
       if (match) {
-        sess.send(`v8 findrefs -r ${match[1]}`);
+        classB = match[1];
+        sess.send(`v8 findrefs -r ${classB}`);
         break;
       }
     }
@@ -114,6 +280,90 @@ function test(executable, core, t) {
   sess.linesUntil(versionMark, (err, lines) => {
     t.error(err);
     t.ok(/Class_C\.arr/.test(lines.join('\n')), 'Should find parent reference' );
+    // Options given after the search value apply as well
+    sess.send(`v8 findrefs -b ${classB} --max-depth 1`);
+    sess.send('version');
+  });
+
+  // Test for breadth-first findrefs
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    t.ok(/Class_C\.arr/.test(lines.join('\n')),
+         'Should find parent reference with -b' );
+
+    sess.waitError(/error:/, (err, line) => {
+      t.error(err);
+      t.ok(/Invalid option value/.test(line),
+           'non-numeric --max-depth should be rejected');
+
+      sess.send('v8 findjsinstances Class_D');
+      sess.send('version');
+    });
+    sess.send(`v8 findrefs -b --max-depth abc ${classB}`);
+  });
+
+  // Test for findroots on the object held by `global.my_class_d`
+  let classD;
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    for (const line of lines) {
+      const match = line.match(/(0x[0-9a-f]+):<Object: Class_D>/i);
+      if (match) {
+        classD = match[1];
+        break;
+      }
+    }
+    t.ok(classD, 'Class_D should be in findjsinstances');
+    sess.send(`v8 findroots -k 1 ${classD}`);
+    sess.send('version');
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    const path = new RegExp(
+        'Path 1, 1 references, held by global object (0x[0-9a-f]+):\n' +
+        ' *\\1: [^\n]*\\.my_class_d=' + classD);
+    t.ok(path.test(lines.join('\n')),
+         'Should find the path from the global object' );
+    sess.send('v8 findjsinstances Class_E');
+    sess.send('version');
+  });
+
+  // Test for findroots on an object held through other objects
+  let classE;
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    for (const line of lines) {
+      const match = line.match(/(0x[0-9a-f]+):<Object: Class_E>/i);
+      if (match) {
+        classE = match[1];
+        break;
+      }
+    }
+    t.ok(classE, 'Class_E should be in findjsinstances');
+
+    sess.waitError(/error:/, (err, line) => {
+      t.error(err);
+      t.ok(/Invalid option/.test(line),
+           'non-numeric --max-paths should be rejected');
+
+      // Options given after the search value apply as well
+      sess.send(`v8 findroots ${classE} -k 1`);
+      sess.send('version');
+    });
+    sess.send(`v8 findroots -k abc ${classE}`);
+  });
+
+  sess.linesUntil(versionMark, (err, lines) => {
+    t.error(err);
+    // References are printed from the root down to the object
+    const path = new RegExp(
+        'Path 1, 3 references, held by global object (0x[0-9a-f]+):\n' +
+        ' *\\1: [^\n]*\\.my_class_e_holder=(0x[0-9a-f]+)\n' +
+        ' *\\2: [^\n]*\\.outer=(0x[0-9a-f]+)\n' +
+        ' *\\3: [^\n]*\\.inner=' + classE);
+    t.ok(path.test(lines.join('\n')),
+         'Should find the path through intermediate objects in order' );
     sess.send('v8 findrefs -n my_class_c');
     sess.send('version');
   });
@@ -195,8 +445,7 @@ function test(executable, core, t) {
       // `waitError()` don't share the same `waitQueue` with `wait()` so that
       // we add the function below to delay the event registration.
       testFindrefsForInvalidExpr(t, sess, () => {
-        sess.quit();
-        t.end();
+        testHeapIndex(t, sess, executable, core, pointerCounts);
       });
     });
   });